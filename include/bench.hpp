@@ -0,0 +1,13 @@
+#pragma once
+
+#include "defs.hpp"
+
+#include <string>
+
+namespace Bench {
+void run(const int depth, const int threads, const int hash);
+void evalSpeed(const std::string& evalFile);
+void timeToDepth(const int depth);
+void depthAtTime(const long long movetime);
+void pgnSpeed(const std::string& path);
+} // namespace Bench
@@ -6,14 +6,9 @@ namespace Bitboard {
 
 void printBits(const uint64_t bitboard);
 
-inline int countBits(uint64_t bitboard) {
-    int count = 0;
-    for (count = 0; bitboard; count++, bitboard &= bitboard - 1)
-        ;
-    return count;
-}
+inline int countBits(const uint64_t bitboard) { return __builtin_popcountll(bitboard); }
 inline int lsbIndex(const uint64_t bitboard) {
-    return bitboard > 0 ? countBits(bitboard ^ (bitboard - 1)) - 1 : 0;
+    return bitboard > 0 ? __builtin_ctzll(bitboard) : 0;
 }
 
 } // namespace Bitboard
\ No newline at end of file
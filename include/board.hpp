@@ -2,6 +2,7 @@
 
 #include "defs.hpp"
 #include "fen.hpp"
+#include "nnue.hpp"
 #include <array>
 #include <string>
 
@@ -27,6 +28,11 @@ struct State
     int castling = 0;
     int fullMoves = 0;
     int halfMoves = 0;
+    uint64_t key = 0ULL;
+    // Evaluation terms updated incrementally by make, from white's point of view
+    int mgScore = 0;
+    int egScore = 0;
+    int phase = 0;
 
     State() = default;
     inline void changeSide() {
@@ -40,9 +46,12 @@ struct Board
     static const std::array<std::string, 8> position;
     Position pos;
     State state;
+    // Only kept up to date while a network is loaded
+    NNUE::Accumulator accumulator;
 
     Board();
     Board(const std::string& fen);
+    std::string toFen() const;
     void display() const;
     void printCastling() const;
     static bool isSquareAttacked(const PieceColor clr, const int sq, const Board& b);
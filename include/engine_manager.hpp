@@ -0,0 +1,79 @@
+#pragma once
+
+#include "defs.hpp"
+#include "spsc_queue.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Runs external UCI engines as child processes. One background thread watches every engine's
+   output with epoll, parses each line into an Event and hands it to the engine's owner through
+   a lock-free queue. Parsing works in place on the read buffer, so no line allocates */
+namespace Engines {
+
+constexpr int MAX_PV = 32;
+// A move in UCI notation, null terminated
+using MoveText = std::array<char, 6>;
+
+enum class EventType : uint8_t { Info, BestMove, UciOk, ReadyOk, Id, Option, Other, Exited };
+
+struct Info
+{
+    int depth = 0;
+    int seldepth = 0;
+    int multipv = 1;
+    bool hasScore = false;
+    // Centipawns, or moves to mate when 'mate' is set
+    int score = 0;
+    bool mate = false;
+    uint64_t nodes = 0;
+    uint64_t nps = 0;
+    long long time = 0;
+    int hashfull = 0;
+    int pvLength = 0;
+    std::array<MoveText, MAX_PV> pv;
+};
+
+struct Event
+{
+    EventType type = EventType::Other;
+    Info info;
+    MoveText bestMove{};
+    MoveText ponderMove{};
+    // The line after its first word for Id, Option and Other events, cut to fit
+    std::array<char, 128> text{};
+};
+
+struct Process
+{
+    int pid = -1;
+    int input = -1;
+    int output = -1;
+    std::atomic<bool> alive = false;
+    SPSCQueue<Event, 1024> events;
+    // Output not yet split into lines, only touched by the event loop
+    std::array<char, 1 << 16> buffer;
+    size_t buffered = 0;
+    uint64_t droppedInfos = 0;
+
+    // Sends one command, the newline is added
+    bool send(std::string_view command);
+    bool poll(Event& event);
+    // Waits for the next event, returns false on timeout
+    bool wait(Event& event, const int timeoutMs);
+    // Skips events until one of the given type arrives
+    bool waitFor(const EventType type, Event& event, const int timeoutMs);
+};
+
+// Prototypes
+Process* spawn(const std::string& path, const std::vector<std::string>& args = {});
+void close(Process* process);
+void shutdown();
+bool parseLine(std::string_view line, Event& event);
+void test(const std::string& enginePath);
+
+} // namespace Engines
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "board.hpp"
+#include "defs.hpp"
+#include "nnue.hpp"
+
+#include <vector>
+
+namespace Eval {
+
+extern const std::array<int, 6> pieceValue; // [piece type]
+// Material plus piece-square value of each piece on each square, positive for white
+extern const std::array<std::array<int, 64>, 12> mgTable; // [piece][square]
+extern const std::array<std::array<int, 64>, 12> egTable; // [piece][square]
+extern const std::array<int, 12> phaseTable;             // [piece]
+
+/* Incremental updates of the evaluation terms kept in the state and of the network
+   accumulator, used by Move::make */
+inline void addPiece(Board& board, const int piece, const int sq) {
+    board.state.mgScore += mgTable[piece][sq];
+    board.state.egScore += egTable[piece][sq];
+    board.state.phase += phaseTable[piece];
+    if (NNUE::loaded)
+        NNUE::addPiece(board.accumulator, piece, sq);
+}
+
+inline void removePiece(Board& board, const int piece, const int sq) {
+    board.state.mgScore -= mgTable[piece][sq];
+    board.state.egScore -= egTable[piece][sq];
+    board.state.phase -= phaseTable[piece];
+    if (NNUE::loaded)
+        NNUE::removePiece(board.accumulator, piece, sq);
+}
+
+inline void movePiece(Board& board, const int piece, const int source, const int target) {
+    board.state.mgScore += mgTable[piece][target] - mgTable[piece][source];
+    board.state.egScore += egTable[piece][target] - egTable[piece][source];
+    if (NNUE::loaded)
+        NNUE::movePiece(board.accumulator, piece, source, target);
+}
+
+/* Direct-mapped cache of evaluations. Each search thread owns one, small enough to stay in
+   its core's caches. An entry packs the upper 48 bits of the key with the 16 bit score */
+struct Cache
+{
+    static constexpr size_t SIZE = 32768; // 256KB
+    std::vector<uint64_t> entries;
+
+    void allocate();
+    inline bool probe(const uint64_t key, int& score) const {
+        uint64_t entry = entries[key & (SIZE - 1)];
+        if ((entry ^ key) >> 16)
+            return false;
+        score = (int16_t)(entry & 0xFFFF);
+        return true;
+    }
+    inline void store(const uint64_t key, const int score) {
+        entries[key & (SIZE - 1)] = (key & ~0xFFFFULL) | (uint16_t)score;
+    }
+};
+
+// Prototypes
+void refresh(Board& board);
+int evaluate(const Board& board);
+Board mirror(const Board& board);
+void test();
+
+} // namespace Eval
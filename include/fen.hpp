@@ -6,7 +6,7 @@ struct FENInfo
 {
     Piece board[64];
     PieceColor side;
-    int castling;
+    int castling = 0;
     Sq enpassant;
     int halfMoves;
     int fullMoves;
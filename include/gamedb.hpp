@@ -0,0 +1,79 @@
+#pragma once
+
+#include "board.hpp"
+#include "mapped_file.hpp"
+#include "pgn.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/* A compact binary game database. The tags are stored column by column, with every distinct
+   string kept once in a shared string table, and each move takes one byte: its index among the
+   legal moves of its position, ordered by piece, source square, target square and promotion. An
+   offset per game gives O(1) access to game N, and the file is memory mapped so only the games
+   that are read get touched. Only the seven tag roster and FEN are kept, any other tag is
+   dropped */
+namespace GameDB {
+
+// The string columns of the header table
+enum Column { Event, Site, Date, Round, White, Black, Fen, ColumnCount };
+
+struct Writer
+{
+    Writer();
+    // Only the moves are stored, so games that didn't replay fully should be left out
+    void add(const PGNInfo& game);
+    bool write(const std::string& path) const;
+    size_t size() const { return results.size(); }
+
+  private:
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> stringIds;
+    std::array<std::vector<uint32_t>, ColumnCount> columns;
+    std::vector<int8_t> results;
+    // Where each game's moves start, with the end of the last one appended
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> moveData;
+
+    uint32_t intern(const std::string& text);
+};
+
+struct Database
+{
+    bool open(const std::string& path);
+    size_t size() const { return games; }
+    PGNHeader header(const size_t game) const;
+    // In plies
+    size_t length(const size_t game) const { return offsets[game + 1] - offsets[game]; }
+    // Replays the game to turn its bytes back into moves, empty if the data is corrupt
+    std::vector<int> moves(const size_t game) const;
+
+  private:
+    MappedFile file;
+    size_t games = 0;
+    const uint64_t* offsets = nullptr;
+    std::array<const uint32_t*, ColumnCount> columns{};
+    const int8_t* results = nullptr;
+    uint32_t stringCount = 0;
+    const uint32_t* stringOffsets = nullptr;
+    const char* stringData = nullptr;
+    const uint8_t* moveData = nullptr;
+
+    std::string_view string(const uint32_t id) const;
+};
+
+// Prototypes
+// The move's byte, or -1 if it isn't legal on the board
+int encodeMove(const Board& board, const int move);
+// The move a byte stands for, 0 if there aren't that many legal moves
+int decodeMove(const Board& board, int index);
+// Both return the number of games converted, or -1 if a file couldn't be read or written
+long long fromPGN(const std::string& pgnPath, const std::string& dbPath);
+long long toPGN(const std::string& dbPath, const std::string& pgnPath);
+void test();
+
+} // namespace GameDB
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "board.hpp"
+#include "engine_manager.hpp"
+#include "search.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Runs an infinite MultiPV search of the GUI's position on a background thread and keeps the
+   latest reported lines for drawing. Given an engine path, an external UCI engine does the
+   searching instead, falling back to the built-in search if it can't be started */
+struct Analysis
+{
+    Analysis(const std::string& enginePath = "");
+    ~Analysis();
+    void start(const Board& board);
+    void stop();
+    std::vector<Search::Info> getLines();
+
+  private:
+    std::thread thread;
+    std::atomic<bool> running = false;
+    std::mutex mutex;
+    std::vector<Search::Info> lines; // [multipv - 1]
+
+    Engines::Process* engine = nullptr;
+    // The position the external engine is searching, its PVs are parsed against it
+    Board board;
+    bool engineSearching = false;
+    void drainEngine();
+};
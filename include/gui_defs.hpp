@@ -3,7 +3,10 @@
 #include "defs.hpp"
 #include "vendor/raylib.h"
 
+#include <string>
+
 extern const float PADDING[2];
 extern const int SQ_SIZE;
 
-int gui_main();
+// Analyses with the UCI engine at enginePath when given, with the built-in search otherwise
+int gui_main(const std::string& enginePath = "");
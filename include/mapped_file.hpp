@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/* A read-only view of a whole file. It's memory mapped where the platform supports it, so
+   pages are only read from disk when touched, and read into memory elsewhere */
+struct MappedFile
+{
+    const char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    void close();
+
+  private:
+    std::vector<char> buffer;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "defs.hpp"
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Plays two UCI engines against each other, one game per core at a time. Every opening is
+   played twice with the colours swapped, and the games are written to a PGN file */
+namespace Match {
+
+struct Settings
+{
+    std::array<std::string, 2> engines;
+    // 'setoption' pairs sent to both engines
+    std::vector<std::pair<std::string, std::string>> options;
+    // EPD or PGN, the start position is used when empty
+    std::string openings;
+    std::string pgnOut = "match.pgn";
+    int games = 100;
+    // Games played at once, one per core when 0
+    int concurrency = 0;
+    // Clock in milliseconds, or a fixed time per move when 'movetime' is set
+    long long baseTime = 10000;
+    long long increment = 100;
+    long long movetime = 0;
+    // Full moves after which the game is drawn, 0 to play on
+    int maxMoves = 200;
+    // A side resigns after reporting a score below -resignScore for resignMoves of its moves
+    int resignScore = 1000;
+    int resignMoves = 3;
+    // Drawn once both sides report scores within drawScore for drawMoves moves each, from move
+    // drawAfter on
+    int drawScore = 10;
+    int drawMoves = 8;
+    int drawAfter = 40;
+    // Sequential probability ratio test of H0: elo = elo0 against H1: elo = elo1. The match
+    // stops as soon as either hypothesis is accepted, 'games' is then only an upper limit
+    bool sprt = false;
+    double elo0 = 0.0;
+    double elo1 = 5.0;
+    double alpha = 0.05;
+    double beta = 0.05;
+};
+
+// Games from the first engine's point of view
+struct Results
+{
+    int wins = 0;
+    int losses = 0;
+    int draws = 0;
+    // Finished game pairs by the first engine's total over both games: 0, 1/2, 1, 3/2 or 2
+    std::array<int, 5> pairs{};
+
+    int games() const { return wins + losses + draws; }
+    double score() const;
+    // Elo difference and the half width of its 95% confidence interval
+    double elo() const;
+    double eloError() const;
+    // Log-likelihood ratio of elo1 against elo0 under the pentanomial model
+    double llr(const double elo0, const double elo1) const;
+};
+
+// Prototypes
+bool loadOpenings(const std::string& path, std::vector<std::string>& fens);
+Results run(const Settings& settings);
+// The LLR at which H0 (lower) or H1 (upper) is accepted
+double lowerBound(const Settings& settings);
+double upperBound(const Settings& settings);
+
+} // namespace Match
@@ -4,6 +4,7 @@
 #include "defs.hpp"
 
 #include <string>
+#include <string_view>
 
 namespace Move {
 
@@ -11,9 +12,12 @@ enum class MoveType { allMoves, onlyCaptures };
 
 struct MoveList {
     std::array<int, 256> list;
+    // Ordering scores, parallel to 'list'. Only filled in by the search
+    std::array<int, 256> scores;
     short count = 0;
     MoveList();
     void add(const int move);
+    int pickNext(const int index);
     int search(const int source, const int target, const int promoted = (int)Piece::E) const;
     void printList() const;
 };
@@ -30,7 +34,12 @@ bool isEnpassant(const int move);
 bool isCastling(const int move);
 std::string toString(const int move);
 int parse(const std::string& moveStr, const Board& board);
+int parseSAN(std::string_view san, const Board& board);
+std::string toSAN(const int move, const Board& board);
+bool isLegal(const Board& board, const int move);
+bool hasLegalMove(const Board& board);
 void generate(MoveList& moveList, const Board& board);
+void generateCaptures(MoveList& moveList, const Board& board);
 void generatePawns(MoveList& moveList, const Board& board);
 void generateKnights(MoveList& moveList, const Board& board);
 void generateBishops(MoveList& moveList, const Board& board);
@@ -40,5 +49,6 @@ void generateKings(MoveList& moveList, const Board& board);
 void genWhiteCastling(MoveList& moveList, const Board& board);
 void genBlackCastling(MoveList& moveList, const Board& board);
 bool make(Board* main, const int move, MoveType moveFlag);
+void makeNull(Board* main);
 
 } // namespace Move
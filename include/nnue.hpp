@@ -0,0 +1,49 @@
+#pragma once
+
+#include "defs.hpp"
+
+#include <string>
+
+struct Board;
+
+namespace NNUE {
+
+/* A (768 -> HIDDEN) x 2 -> 1 perspective network. Each side has its own accumulator over the
+   768 piece-square features seen from its point of view, and the output layer takes the side
+   to move's half first */
+constexpr int INPUTS = 768;
+constexpr int HIDDEN = 128;
+// Quantization of the accumulator and of the output weights
+constexpr int QA = 255;
+constexpr int QB = 64;
+// Converts the network output to centipawns
+constexpr int SCALE = 400;
+
+struct Accumulator
+{
+    alignas(32) std::array<std::array<int16_t, HIDDEN>, 2> values; // [perspective][neuron]
+};
+
+// Points into the mapped network file
+struct Network
+{
+    const int16_t* featureWeights = nullptr; // [feature][neuron]
+    const int16_t* featureBias = nullptr;    // [neuron]
+    const int16_t* outputWeights = nullptr;  // [2 * HIDDEN]
+    int32_t outputBias = 0;
+};
+
+extern Network network;
+// Set while a network is loaded, the handcrafted evaluation is used otherwise
+extern bool loaded;
+
+// Prototypes
+bool load(const std::string& path);
+void unload();
+void refresh(Accumulator& accumulator, const Board& board);
+void addPiece(Accumulator& accumulator, const int piece, const int sq);
+void removePiece(Accumulator& accumulator, const int piece, const int sq);
+void movePiece(Accumulator& accumulator, const int piece, const int source, const int target);
+int evaluate(const Accumulator& accumulator, const PieceColor side);
+
+} // namespace NNUE
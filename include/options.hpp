@@ -0,0 +1,36 @@
+#pragma once
+
+#include "defs.hpp"
+
+#include <string>
+#include <vector>
+
+namespace Options {
+
+enum class OptionType { Spin, Check, String };
+
+struct Option
+{
+    std::string name;
+    OptionType type;
+    int defaultValue;
+    int min, max;
+    int value;
+    // Called with the new value whenever the option changes, may be null
+    void (*onChange)(int value);
+    // String options keep their value here instead
+    std::string defaultText;
+    std::string text;
+    void (*onTextChange)(const std::string& text);
+};
+
+extern std::vector<Option> options;
+
+// Prototypes
+void init();
+bool set(const std::string& name, const std::string& value);
+int get(const std::string& name);
+std::string getText(const std::string& name);
+void print();
+
+} // namespace Options
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Helpers for the batch jobs (tuning, tablebase generation, PGN import) that fan out over cores
+namespace Parallel {
+
+// 'requested' if it's positive, otherwise one thread per hardware thread
+inline int threadCount(const int requested = 0) {
+    return requested > 0 ? requested : std::max(1u, std::thread::hardware_concurrency());
+}
+
+/* Splits [0, count) into one range per thread and waits for all of them */
+template <typename Function>
+void parallelFor(const size_t count, const int threads, Function function) {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        size_t begin = count * t / threads, end = count * (t + 1) / threads;
+        workers.emplace_back([=, &function] { function(begin, end, t); });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+} // namespace Parallel
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <functional>
+#include <string>
+#include <string_view>
 #include <vector>
-#include <regex>
 
+#include "board.hpp"
 #include "defs.hpp"
+#include "mapped_file.hpp"
 
 enum class GameResult {
     BlackWin = -1,
@@ -12,28 +16,147 @@ enum class GameResult {
     InProgress,
 };
 
+/* Streaming PGN reading. A Reader splits a buffer, normally a memory mapped file, into games
+   of tag pairs and movetext, and a Lexer splits movetext into tokens. Everything handed out is
+   a view into the buffer, so reading allocates nothing per token and nothing per game once the
+   tag list has grown to its largest size */
+namespace PGN {
+
+struct Tag
+{
+    std::string_view name;
+    // Between the quotes, escaped characters are left as they are
+    std::string_view value;
+};
+
+struct Game
+{
+    std::vector<Tag> tags;
+    std::string_view movetext;
+
+    // Empty if the tag isn't there
+    std::string_view tag(std::string_view name) const;
+};
+
+struct Reader
+{
+    Reader() = default;
+    Reader(std::string_view text) : text(text) {}
+    bool open(const std::string& path);
+    // Reads the next game, returns false at the end of the text
+    bool next(Game& game);
+    // How far into the text reading has got
+    size_t position() const { return pos; }
+
+  private:
+    MappedFile file;
+    std::string_view text;
+    size_t pos = 0;
+
+    void skipLine();
+    bool readTag(Tag& tag);
+    void readMovetext(Game& game);
+};
+
+enum class TokenType : uint8_t {
+    Move,
+    MoveNumber,
+    // '$n' or a '!' and '?' suffix written apart from its move
+    Nag,
+    Comment,
+    VariationStart,
+    VariationEnd,
+    Result,
+    End
+};
+
+struct Token
+{
+    TokenType type = TokenType::End;
+    // Comments without their braces or semicolon
+    std::string_view text;
+};
+
+struct Lexer
+{
+    Lexer(std::string_view movetext) : text(movetext) {}
+    Token next();
+    // Skips comments, annotations and variations, returns false once the mainline ends
+    bool nextMove(std::string_view& san);
+
+  private:
+    std::string_view text;
+    size_t pos = 0;
+    int variationDepth = 0;
+};
+
+GameResult parseResult(std::string_view result);
+void test();
+
+} // namespace PGN
+
 struct PGNHeader
 {
     // Required tags
     std::string event;
     std::string site;
     std::string date;
-    int round = -1;
+    // Kept as text, rounds like "3.1" or "-" aren't numbers
+    std::string round;
     std::string players[2];
-    GameResult result;
+    GameResult result = GameResult::InProgress;
+    // Only set for games that don't start from the initial position
+    std::string fen;
 
-    PGNHeader(const std::string& header);
-    void parseResult(const std::string& result_str);
+    PGNHeader() = default;
+    PGNHeader(const PGN::Game& game);
 };
 
 struct PGNInfo
 {
     PGNHeader header;
     std::vector<int> moves;
+    // False if a move couldn't be resolved, 'moves' then holds the ones before it
+    bool valid = true;
+
+    PGNInfo(const PGN::Game& game);
+};
+
+/* Importing replays every game, which costs far more than reading it, so it's spread over a
+   pool of threads. The file is cut into chunks that each start at an '[Event ' line, and the
+   threads take chunks from a shared counter */
+namespace PGN {
 
-    PGNInfo(const std::string& headerStr, const std::string& movesStr);
+enum class Order {
+    // Games reach the sink one at a time in file order, finished chunks wait for earlier ones
+    Kept,
+    // Games reach the sink as soon as they're replayed, from every thread at once
+    Any
+};
+
+struct ImportSettings
+{
+    // One per core when 0
+    int threads = 0;
+    Order order = Order::Kept;
+    size_t chunkSize = 4 << 20;
 };
 
+// 'thread' is in [0, threads), so an unordered sink can keep one accumulator per thread
+using Sink = std::function<void(const PGNInfo& game, const int thread)>;
+
+// Prototypes
+// Returns the number of games, or -1 if the file couldn't be read
+long long import(const std::string& path, const Sink& sink, const ImportSettings& settings = {});
+/* Writes the moves from 'start' with their numbers, wrapped under 80 columns, then the result.
+   'comments' holds one comment per move or is empty, 'ending' is an optional comment on how the
+   game ended */
+void writeMovetext(std::ostream& out, const Board& start, const std::vector<std::string>& san,
+                   const std::vector<std::string>& comments, const std::string& result,
+                   const std::string& ending = "");
+
+} // namespace PGN
+
 enum class MoveType {
     Quiet,
     Capture,
@@ -48,16 +171,25 @@ enum class MoveAnnotation {
     Checkmate
 };
 
+/* A move in standard algebraic notation taken apart, like "Nbd7", "exd8=Q+" or "O-O-O" */
 struct MoveInfo
 {
-    Piece piece, promoted = Piece::E;
-    char disambiguate;
-    MoveType type;
-    Sq target;
+    PieceTypes piece = PieceTypes::PAWN;
+    // The white piece of the promoted type, E without a promotion
+    Piece promoted = Piece::E;
+    // Source file and rank given for disambiguation, -1 when absent. Ranks count from the 8th
+    // like square indices do
+    int fromFile = -1;
+    int fromRank = -1;
+    MoveType type = MoveType::Quiet;
+    // Not set for castling, which side of the board decides
+    Sq target = Sq::noSq;
+    bool queenside = false;
     MoveAnnotation annotation = MoveAnnotation::None;
 
-    MoveInfo(const std::smatch& match, bool isWhiteToMove);
-    void printInfo();
-  private:
-    void parseMoves(const std::smatch& match, bool isWhiteToMove);
+    // Returns false if the text isn't a move
+    bool parse(std::string_view san);
+    // The legal move it stands for on the board, 0 if there's none
+    int resolve(const Board& board) const;
+    void printInfo() const;
 };
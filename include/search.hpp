@@ -0,0 +1,169 @@
+#pragma once
+
+#include "board.hpp"
+#include "defs.hpp"
+#include "eval.hpp"
+#include "move.hpp"
+#include "stats.hpp"
+#include "timeman.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace Search {
+
+constexpr int MAX_PLY = 64;
+constexpr int INF = 50000;
+constexpr int MATE_VALUE = 49000;
+// Any score beyond this bound is a forced mate
+constexpr int MATE_SCORE = 48000;
+// Tablebase wins score below any mate, but above anything the evaluation produces
+constexpr int TB_WIN = 47000;
+constexpr int TB_WIN_SCORE = TB_WIN - MAX_PLY;
+
+struct Limits
+{
+    int depth = MAX_PLY;
+    uint64_t nodes = 0;     // 0 means no node limit
+    long long movetime = 0; // 0 means no time limit (in ms)
+    // Clock state as sent by 'go', all in ms
+    long long wtime = 0, btime = 0;
+    long long winc = 0, binc = 0;
+    int movestogo = 0;
+    bool infinite = false;
+    // Search on the opponent's time until 'ponderhit' or 'stop'
+    bool ponder = false;
+    // Root moves to choose from, every legal move when empty
+    std::vector<int> searchMoves;
+    // Stop once a mate in this many moves or fewer is proven, 0 to ignore
+    int mate = 0;
+};
+
+// Selective search techniques, each switchable by an option for A/B testing
+struct Features
+{
+    bool nullMove = true;
+    bool lmr = true;
+    bool futility = true;
+    bool checkExtensions = true;
+};
+
+struct Info
+{
+    int depth = 0;
+    int multipv = 1;
+    int score = 0;
+    uint64_t nodes = 0;
+    long long time = 0;
+    int hashfull = 0;
+    std::vector<int> pv;
+};
+
+struct Worker
+{
+    int id;
+    Board board;
+    Limits limits;
+    Features features;
+    // Read by the main thread while helpers search, hence atomic
+    std::atomic<uint64_t> nodes = 0;
+    uint64_t qnodes = 0;
+    uint64_t ttProbes = 0;
+    uint64_t ttHits = 0;
+    Eval::Cache evalCache;
+    int ply = 0;
+    long long startTime = 0;
+    // Only used by the main thread
+    TimeMan::Manager timeManager;
+    // Keys of the positions on the current search path, used to detect repetitions
+    std::array<uint64_t, MAX_PLY> keyStack{};
+    // Keys of the game's positions before the root, oldest first. Only the ones since the last
+    // capture or pawn move are kept, as no earlier position can repeat
+    std::vector<uint64_t> gameHistory;
+    // Moves played on the current search path
+    std::array<int, MAX_PLY> moveStack{};
+
+    // Move ordering heuristics
+    std::array<std::array<int, 2>, MAX_PLY> killers{};                        // [ply][slot]
+    std::array<std::array<std::array<int, 64>, 64>, 2> history{};             // [side][source][target]
+    std::array<std::array<int, 64>, 12> counterMoves{};                       // [piece][target]
+    uint64_t betaCutoffs = 0;
+    uint64_t firstMoveCutoffs = 0;
+    // Triangular principal variation table
+    std::array<int, MAX_PLY> pvLength{};
+    std::array<std::array<int, MAX_PLY>, MAX_PLY> pvTable{};
+    // Result of the last completed iteration
+    int completedDepth = 0;
+    int bestScore = -INF;
+    std::vector<int> pv;
+
+    // MultiPV: each root move already reported in an earlier line of this iteration is
+    // excluded when searching for the next line
+    struct Line
+    {
+        int score;
+        std::vector<int> pv;
+    };
+    int multiPV = 1;
+    std::vector<int> excludedMoves;
+    std::vector<Line> lines;
+
+#ifdef CEGUI_STATS
+    uint64_t ttCutoffs = 0;
+    uint64_t evalProbes = 0;
+    uint64_t evalHits = 0;
+    uint64_t nullMoveTries = 0;
+    uint64_t nullMoveCutoffs = 0;
+    uint64_t lmrSearches = 0;
+    uint64_t lmrResearches = 0;
+    // Per iteration differences of the counters, main thread only
+    std::vector<Stats::Iteration> iterations;
+    Stats::Iteration totals;
+#endif
+
+    Worker(const int id, const Board& b, const Limits& l);
+    int iterate();
+    int negamax(int alpha, int beta, int depth);
+    int quiescence(int alpha, int beta);
+
+  private:
+    bool isPondering();
+    int evaluate();
+#ifdef CEGUI_STATS
+    void recordIteration(const int depth);
+#endif
+    void scoreMoves(Move::MoveList& moveList, const int ttMove) const;
+    void scoreCaptures(Move::MoveList& moveList) const;
+    void updateQuietStats(const int move, const int depth, const int* quiets, const int quietCount);
+    bool skipDepth(const int depth) const;
+    bool isRootMove(const int move) const;
+    void checkLimits();
+    bool isDraw() const;
+};
+
+extern std::atomic<bool> stopped;
+extern std::atomic<bool> pondering;
+// Suppresses all 'info' and 'bestmove' output when set
+extern bool silent;
+// Receives the main thread's 'info' reports, e.g. for the GUI. Called from the search thread
+extern std::function<void(const Info&)> onInfo;
+extern std::vector<std::unique_ptr<Worker>> workers;
+
+// Prototypes
+long long now();
+int search(const Board& board, const Limits& limits, const std::vector<uint64_t>& history = {});
+// Runs the search on a new thread, which reports 'bestmove' when it's done
+std::thread start(const Board& board, const Limits& limits,
+                  const std::vector<uint64_t>& history = {});
+void stop();
+void ponderhit();
+// Whether a search started by 'start' is still running
+bool isRunning();
+void printInfo(const Info& info);
+// Prints the main thread's per iteration statistics of the last search
+void printStats();
+
+} // namespace Search
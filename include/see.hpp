@@ -0,0 +1,14 @@
+#pragma once
+
+#include "board.hpp"
+#include "defs.hpp"
+
+namespace See {
+
+extern const std::array<int, 6> seeValue; // [piece type]
+
+// Prototypes
+uint64_t attackersTo(const Board& board, const int sq, const uint64_t occupancy);
+int evaluate(const Board& board, const int move);
+
+} // namespace See
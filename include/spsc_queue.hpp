@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/* Bounded lock-free queue for exactly one producer thread and one consumer thread. Each index
+   is only written by its own side, so a push or pop is a copy plus one release store */
+template <typename T, size_t Capacity>
+struct SPSCQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    // Producer only, returns false when the queue is full
+    bool push(const T& item) {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items[tail & (Capacity - 1)] = item;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, returns false when the queue is empty
+    bool pop(T& item) {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire))
+            return false;
+        item = items[head & (Capacity - 1)];
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    std::array<T, Capacity> items;
+    // On separate cache lines so the two threads don't invalidate each other's
+    alignas(64) std::atomic<size_t> headIndex = 0;
+    alignas(64) std::atomic<size_t> tailIndex = 0;
+};
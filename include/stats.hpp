@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Search statistics are only collected when built with -DCEGUI_STATS ('make STATS=1'). Otherwise
+// every STATS_INC expands to nothing and the counters don't exist
+#ifdef CEGUI_STATS
+    #define STATS_INC(counter) ((counter)++)
+#else
+    #define STATS_INC(counter) ((void)0)
+#endif
+
+namespace Stats {
+
+// Counters of a single iteration of the main thread
+struct Iteration
+{
+    int depth = 0;
+    long long time = 0;
+    uint64_t nodes = 0;
+    uint64_t qnodes = 0;
+    uint64_t ttProbes = 0;
+    uint64_t ttHits = 0;
+    uint64_t ttCutoffs = 0;
+    uint64_t evalProbes = 0;
+    uint64_t evalHits = 0;
+    uint64_t betaCutoffs = 0;
+    uint64_t firstMoveCutoffs = 0;
+    uint64_t nullMoveTries = 0;
+    uint64_t nullMoveCutoffs = 0;
+    uint64_t lmrSearches = 0;
+    uint64_t lmrResearches = 0;
+};
+
+void print(const std::vector<Iteration>& iterations);
+std::string toJson(const std::vector<Iteration>& iterations);
+
+} // namespace Stats
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "board.hpp"
+#include "defs.hpp"
+
+#include <string>
+
+namespace Tablebase {
+
+/* Endgame tablebases built by retrograde analysis. Each material configuration has a WDL file
+   (win/draw/loss) and a DTZ file (distance to the next capture or pawn move, in plies). Both are
+   run-length coded in fixed size blocks and memory mapped, so a probe only decodes the block its
+   position lives in and nothing is decompressed when the tables are loaded.
+
+   The tables ignore castling, en passant and the fifty move rule */
+
+// Results from the side to move's point of view
+enum class WDL : int8_t { Loss = -1, Draw = 0, Win = 1 };
+
+// Largest configuration the generator supports, kings included
+constexpr int MAX_MEN = 5;
+
+// Piece count of the largest loaded tables, 0 if none are loaded
+extern int maxMen;
+
+// Prototypes
+int init(const std::string& dir);
+bool generate(const std::string& dir, const int men);
+bool probeWDL(const Board& board, WDL& wdl);
+bool probeDTZ(const Board& board, WDL& wdl, int& dtz);
+bool probeRoot(const Board& board, int& move, WDL& wdl, int& dtz);
+
+} // namespace Tablebase
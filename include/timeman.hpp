@@ -0,0 +1,27 @@
+#pragma once
+
+#include "defs.hpp"
+
+namespace Search {
+struct Limits;
+}
+
+namespace TimeMan {
+
+struct Manager
+{
+    long long startTime = 0;
+    // Iterative deepening stops starting new iterations after the soft limit, while the
+    // search is interrupted outright at the hard limit
+    long long softLimit = 0;
+    long long hardLimit = 0;
+    bool enabled = false;
+    bool fixedTime = false;
+
+    void init(const Search::Limits& limits, const PieceColor side, const long long start);
+    long long elapsed() const;
+    bool hardLimitReached() const;
+    bool stopIteration(const int stableIterations, const int scoreDrop) const;
+};
+
+} // namespace TimeMan
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "defs.hpp"
+
+#include <atomic>
+
+namespace TT {
+
+enum class Bound : uint8_t { None, Upper, Lower, Exact };
+
+struct Entry
+{
+    int move = 0;
+    int score = 0;
+    int depth = 0;
+    Bound bound = Bound::None;
+};
+
+/* A slot stores the position key XOR'd with its packed data. A reader only accepts the slot if
+   'key ^ data' reproduces the probed key, so a slot torn by a concurrent writer is rejected
+   instead of returning another position's data. This lets every search thread share the table
+   without locks.
+
+   Packed data layout:
+       0 - 23: move
+      24 - 47: score, wide enough for mate and tablebase scores
+      48 - 55: depth
+      56 - 57: bound
+      58 - 63: age
+*/
+struct Slot
+{
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> data;
+};
+
+constexpr int BUCKET_SIZE = 4;
+
+// One bucket fills exactly one cache line, so a probe touches a single line of memory
+struct alignas(64) Bucket
+{
+    Slot slots[BUCKET_SIZE];
+};
+
+static_assert(sizeof(Bucket) == 64, "TT buckets must be one cache line");
+
+// Prototypes
+void resize(const size_t mb);
+void clear();
+void newSearch();
+bool probe(const uint64_t key, Entry& entry);
+void store(const uint64_t key, const int move, const int score, const int depth, const Bound bound);
+void prefetch(const uint64_t key);
+int hashfull();
+void test();
+
+} // namespace TT
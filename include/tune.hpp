@@ -0,0 +1,39 @@
+#pragma once
+
+#include "defs.hpp"
+
+#include <string>
+#include <vector>
+
+namespace Tune {
+
+/* Positions reduced to the linear form of the handcrafted evaluation: each piece is one
+   feature, and the evaluation is the phase blend of the summed midgame and endgame weights */
+struct Dataset
+{
+    // Per feature: (piece type * 64 + square from white's side) * 2 + 1 if the piece is black
+    std::vector<uint16_t> features;
+    // Position i owns features[offsets[i], offsets[i + 1])
+    std::vector<uint32_t> offsets = {0};
+    std::vector<uint8_t> phases;
+    // Game result from white's point of view: 1, 0.5 or 0
+    std::vector<float> results;
+
+    size_t size() const { return results.size(); }
+    void append(const Dataset& other);
+};
+
+struct Settings
+{
+    std::vector<std::string> files;
+    int epochs = 500;
+    double learningRate = 1.0;
+    std::string output = "eval_constants.hpp";
+};
+
+// Prototypes
+bool loadEPD(const std::string& path, Dataset& dataset);
+bool loadPGN(const std::string& path, Dataset& dataset);
+void run(const Settings& settings);
+
+} // namespace Tune
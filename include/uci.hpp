@@ -1,5 +1,12 @@
 #pragma once
 
+#include "board.hpp"
 #include "defs.hpp"
+#include "search.hpp"
 
+#include <string>
+
+// Moves after 'searchmoves' are checked against the board, illegal ones are left out
+Search::Limits parseGoCmd(const std::string& goCmd, const Board& board);
+void uciLoop();
 void uciTest();
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "board.hpp"
+#include "defs.hpp"
+
+namespace Zobrist {
+
+extern std::array<std::array<uint64_t, 64>, 12> pieceKeys; // [piece][square]
+extern std::array<uint64_t, 64> enpassantKeys;             // [square]
+extern std::array<uint64_t, 16> castlingKeys;              // [castling rights]
+extern uint64_t sideKey;
+
+// Prototypes
+void init();
+uint64_t generate(const Board& board);
+
+} // namespace Zobrist
@@ -0,0 +1,287 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "board.hpp"
+#include "eval.hpp"
+#include "move.hpp"
+#include "nnue.hpp"
+#include "options.hpp"
+#include "parallel.hpp"
+#include "pgn.hpp"
+#include "search.hpp"
+#include "tt.hpp"
+
+namespace Bench {
+
+// Positions searched by 'bench' in addition to the standard ones, a mix of openings,
+// middlegames and endgames. Changing this list changes the node signature
+const std::array<std::string, 34> benchPositions = {
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+    "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+    "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+    "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+    "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/8 b - - 3 54",
+    "3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+    "2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+    "8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+    "7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+    "8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+    "8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+    "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+    "8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+    "5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+    "6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+    "1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+    "6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+    "8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+    "5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+    "4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+    "r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+    "3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+    "4k3/3q1r2/1N2r1b1/3ppN2/2nPP3/1B1R2n1/2R1Q3/3K4 w - - 5 1",
+};
+
+std::vector<std::string> allPositions() {
+    std::vector<std::string> fens(Board::position.begin() + 1, Board::position.end());
+    fens.insert(fens.end(), benchPositions.begin(), benchPositions.end());
+    return fens;
+}
+
+/* Searches each position to a fixed depth from a cleared hash table, adding up the nodes and
+   the time taken */
+void searchAll(const std::vector<std::string>& fens, const int depth, const bool verbose,
+               uint64_t& totalNodes, long long& totalTime) {
+    Search::Limits limits;
+    limits.depth = depth;
+    Search::silent = true;
+    totalNodes = 0;
+    totalTime = 0;
+    for (size_t i = 0; i < fens.size(); i++) {
+        TT::clear();
+        Board board(fens[i]);
+        long long start = Search::now();
+        Search::search(board, limits);
+        totalTime += Search::now() - start;
+        uint64_t nodes = 0;
+        for (auto& worker : Search::workers)
+            nodes += worker->nodes;
+        totalNodes += nodes;
+        if (verbose)
+            printf("Position %2zu/%zu: %12llu nodes\n", i + 1, fens.size(),
+                   (unsigned long long)nodes);
+    }
+    Search::silent = false;
+}
+
+/* Searches every standard and bench position to a fixed depth from a cleared hash table. The
+   total node count is the functional signature of the build: it only changes when the search
+   or evaluation does, while the NPS tracks speed. More than one thread isn't deterministic */
+void run(const int depth, const int threads, const int hash) {
+    Options::set("Threads", std::to_string(threads));
+    Options::set("Hash", std::to_string(hash));
+    // Tables in the working directory would change the node count
+    Options::set("TablebasePath", "");
+
+    uint64_t totalNodes = 0;
+    long long totalTime = 0;
+    searchAll(allPositions(), depth, true, totalNodes, totalTime);
+
+    printf("\n===========================\n");
+    printf("Total time (ms) : %lld\n", totalTime);
+    printf("Nodes searched  : %llu\n", (unsigned long long)totalNodes);
+    printf("Nodes/second    : %llu\n",
+           (unsigned long long)(totalTime ? totalNodes * 1000 / totalTime : totalNodes));
+}
+
+/* Compares the handcrafted evaluation with the network: raw evaluations per second over the
+   bench positions and their children, and the search speed at a fixed depth */
+void evalSpeed(const std::string& evalFile) {
+    constexpr int EVAL_ROUNDS = 2000;
+    constexpr int SEARCH_DEPTH = 8;
+
+    std::vector<std::string> fens = allPositions();
+    std::vector<Board> boards;
+    for (const std::string& fen : fens) {
+        Board board(fen);
+        boards.push_back(board);
+        Move::MoveList moveList;
+        Move::generate(moveList, board);
+        for (int i = 0; i < moveList.count; i++) {
+            Board child = board;
+            if (Move::make(&child, moveList.list[i], Move::MoveType::allMoves))
+                boards.push_back(child);
+        }
+    }
+
+    std::cout << "\n----------------- Evaluation speed -----------------\n";
+    std::cout << "  Evaluation   |     Evals/s |   Search NPS\n";
+    for (int useNetwork = 0; useNetwork < 2; useNetwork++) {
+        if (useNetwork && !Options::set("EvalFile", evalFile))
+            break;
+        if (useNetwork && !NNUE::loaded)
+            break;
+        for (Board& board : boards)
+            Eval::refresh(board);
+
+        // Summed so the evaluations can't be optimized away
+        long long checksum = 0;
+        long long start = Search::now();
+        for (int round = 0; round < EVAL_ROUNDS; round++) {
+            for (const Board& board : boards)
+                checksum += Eval::evaluate(board);
+        }
+        long long evalTime = std::max(1LL, Search::now() - start);
+        uint64_t evals = (uint64_t)EVAL_ROUNDS * boards.size();
+
+        uint64_t nodes = 0;
+        long long searchTime = 0;
+        searchAll(fens, SEARCH_DEPTH, false, nodes, searchTime);
+        printf("  %-12s | %11llu | %12llu   (checksum %lld)\n",
+               useNetwork ? "network" : "handcrafted", (unsigned long long)(evals * 1000 / evalTime),
+               (unsigned long long)(searchTime ? nodes * 1000 / searchTime : nodes), checksum);
+    }
+    Options::set("EvalFile", "");
+}
+
+/* Measures how long it takes to reach a fixed depth over the standard positions with 1, 2, 4,
+   8 and 16 threads. Lazy SMP gains show up as a shorter time to depth, not as more nodes */
+void timeToDepth(const int depth) {
+    const int threadCounts[] = {1, 2, 4, 8, 16};
+    long long baseTime = 0;
+
+    Search::Limits limits;
+    limits.depth = depth;
+    Search::silent = true;
+
+    std::cout << "\n----------------- Time to depth (" << depth << ") -----------------\n";
+    std::cout << "  Threads |    Time (ms) |        Nodes |  Speedup\n";
+    for (int threads : threadCounts) {
+        Options::set("Threads", std::to_string(threads));
+        long long totalTime = 0;
+        uint64_t totalNodes = 0;
+        // Skip the empty board, there's nothing to search
+        for (size_t i = 1; i < Board::position.size(); i++) {
+            TT::clear();
+            Board board(Board::position[i]);
+            long long start = Search::now();
+            Search::search(board, limits);
+            totalTime += Search::now() - start;
+            for (auto& worker : Search::workers)
+                totalNodes += worker->nodes;
+        }
+        if (threads == 1)
+            baseTime = totalTime;
+        printf("  %7d | %12lld | %12llu | %7.2fx\n", threads, totalTime,
+               (unsigned long long)totalNodes, totalTime ? (double)baseTime / totalTime : 0.0);
+    }
+
+    Search::silent = false;
+    Options::set("Threads", "1");
+}
+
+/* Searches every standard position for a fixed time with all selective search techniques
+   enabled and then with each one disabled in turn, and prints the average depth reached */
+void depthAtTime(const long long movetime) {
+    const std::string features[] = {"NullMove", "LMR", "Futility", "CheckExtensions"};
+
+    Search::Limits limits;
+    limits.movetime = movetime;
+    Search::silent = true;
+
+    std::cout << "\n----------------- Depth at fixed time (" << movetime << "ms) -----------------\n";
+    std::cout << "  Configuration        |  Avg depth |        Nodes\n";
+    // Configuration -1 is the baseline with everything enabled
+    for (int disabled = -1; disabled < (int)std::size(features); disabled++) {
+        if (disabled >= 0)
+            Options::set(features[disabled], "false");
+        int totalDepth = 0, count = 0;
+        uint64_t totalNodes = 0;
+        for (size_t i = 1; i < Board::position.size(); i++) {
+            TT::clear();
+            Board board(Board::position[i]);
+            Search::search(board, limits);
+            totalDepth += Search::workers[0]->completedDepth;
+            totalNodes += Search::workers[0]->nodes;
+            count++;
+        }
+        std::string name = disabled < 0 ? "all enabled" : "no " + features[disabled];
+        printf("  %-20s | %10.2f | %12llu\n", name.c_str(), (double)totalDepth / count,
+               (unsigned long long)totalNodes);
+        if (disabled >= 0)
+            Options::set(features[disabled], "true");
+    }
+
+    Search::silent = false;
+}
+
+/* Reads a PGN file twice: once only splitting it into tokens, once also replaying every game,
+   which is what importing costs */
+void pgnSpeed(const std::string& path) {
+    PGN::Reader reader;
+    if (!reader.open(path)) {
+        std::cout << "Failed to open '" << path << "'\n";
+        return;
+    }
+    PGN::Game game;
+    uint64_t games = 0, tokens = 0, bytes = 0;
+    long long start = Search::now();
+    while (reader.next(game)) {
+        games++;
+        PGN::Lexer lexer(game.movetext);
+        while (lexer.next().type != PGN::TokenType::End)
+            tokens++;
+    }
+    bytes = reader.position();
+    long long readTime = std::max(1LL, Search::now() - start);
+
+    reader.open(path);
+    uint64_t moves = 0, invalid = 0;
+    start = Search::now();
+    while (reader.next(game)) {
+        PGNInfo info(game);
+        moves += info.moves.size();
+        invalid += !info.valid;
+    }
+    long long replayTime = std::max(1LL, Search::now() - start);
+
+    // The same replay spread over every core, with per-thread counters so nothing is shared
+    PGN::ImportSettings settings;
+    settings.order = PGN::Order::Any;
+    int threads = Parallel::threadCount(settings.threads);
+    std::vector<uint64_t> threadMoves(threads * 8, 0);
+    start = Search::now();
+    PGN::import(path, [&](const PGNInfo& info, const int thread) {
+        // Spaced a cache line apart
+        threadMoves[thread * 8] += info.moves.size();
+    }, settings);
+    long long importTime = std::max(1LL, Search::now() - start);
+
+    std::cout << "\n----------------- PGN speed -----------------\n";
+    printf("  %llu games, %llu tokens, %llu moves, %llu unreadable games\n",
+           (unsigned long long)games, (unsigned long long)tokens, (unsigned long long)moves,
+           (unsigned long long)invalid);
+    printf("  Tokenize: %6lld ms, %8.1f MB/s\n", readTime, bytes / 1e3 / readTime);
+    printf("  Replay:   %6lld ms, %8.1f MB/s, %llu games/s\n", replayTime, bytes / 1e3 / replayTime,
+           (unsigned long long)(games * 1000 / replayTime));
+    printf("  Import:   %6lld ms, %8.1f MB/s, %llu games/s with %d threads\n", importTime,
+           bytes / 1e3 / importTime, (unsigned long long)(games * 1000 / importTime), threads);
+}
+
+} // namespace Bench
@@ -5,7 +5,9 @@
 
 #include "attack.hpp"
 #include "bitboard.hpp"
+#include "eval.hpp"
 #include "magics.hpp"
+#include "zobrist.hpp"
 
 const std::string pieceStr = "PNBRQKpnbrqk ";
 
@@ -56,6 +58,42 @@ Board::Board(const std::string &fen) {
     parseFen(f);
 }
 
+std::string Board::toFen() const {
+    std::string fen;
+    for (int r = 0; r < 8; r++) {
+        int empty = 0;
+        for (int f = 0; f < 8; f++) {
+            int piece = pos.getPieceOnSquare(SQ(r, f));
+            if (piece == (int)Piece::E) {
+                empty++;
+                continue;
+            }
+            if (empty)
+                fen += '0' + empty;
+            fen += pieceStr[piece];
+            empty = 0;
+        }
+        if (empty)
+            fen += '0' + empty;
+        if (r < 7)
+            fen += '/';
+    }
+    fen += state.side == PieceColor::LIGHT ? " w " : " b ";
+    std::string castlingLtrs;
+    for (int right = 0; right < 4; right++) {
+        if (state.castling & (1 << right))
+            castlingLtrs += "KQkq"[right];
+    }
+    fen += castlingLtrs.empty() ? "-" : castlingLtrs;
+    fen += ' ';
+    fen += state.enpassant != Sq::noSq ? strCoords[(int)state.enpassant] : "-";
+    fen += ' ';
+    fen += std::to_string(state.halfMoves);
+    fen += ' ';
+    fen += std::to_string(state.fullMoves);
+    return fen;
+}
+
 void Board::display() const {
     std::cout << "\n    +---+---+---+---+---+---+---+---+\n";
     for (int r = 0; r < 8; r++) {
@@ -151,4 +189,6 @@ void Board::parseFen(FENInfo fen) {
     state.castling = fen.castling;
     state.halfMoves = fen.halfMoves;
     state.fullMoves = fen.fullMoves;
+    state.key = Zobrist::generate(*this);
+    Eval::refresh(*this);
 }
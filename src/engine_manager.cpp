@@ -0,0 +1,485 @@
+#include "engine_manager.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <csignal>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace Engines {
+
+/* Parsing */
+
+std::string_view nextToken(std::string_view& rest) {
+    size_t begin = rest.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) {
+        rest = {};
+        return {};
+    }
+    size_t end = rest.find_first_of(" \t", begin);
+    std::string_view token = rest.substr(begin, end - begin);
+    rest = end == std::string_view::npos ? std::string_view() : rest.substr(end);
+    return token;
+}
+
+template <typename T>
+void parseNumber(std::string_view& rest, T& value) {
+    std::string_view token = nextToken(rest);
+    std::from_chars(token.data(), token.data() + token.size(), value);
+}
+
+void copyMove(std::string_view token, MoveText& move) {
+    size_t length = std::min(token.size(), move.size() - 1);
+    std::memcpy(move.data(), token.data(), length);
+    move[length] = '\0';
+}
+
+void copyText(std::string_view text, std::array<char, 128>& out) {
+    size_t begin = text.find_first_not_of(" \t");
+    text = begin == std::string_view::npos ? std::string_view() : text.substr(begin);
+    size_t length = std::min(text.size(), out.size() - 1);
+    std::memcpy(out.data(), text.data(), length);
+    out[length] = '\0';
+}
+
+void parseInfo(std::string_view rest, Event& event) {
+    Info& info = event.info;
+    info = Info();
+    for (std::string_view key = nextToken(rest); !key.empty(); key = nextToken(rest)) {
+        if (key == "depth") {
+            parseNumber(rest, info.depth);
+        } else if (key == "seldepth") {
+            parseNumber(rest, info.seldepth);
+        } else if (key == "multipv") {
+            parseNumber(rest, info.multipv);
+        } else if (key == "score") {
+            info.hasScore = true;
+            info.mate = nextToken(rest) == "mate";
+            parseNumber(rest, info.score);
+        } else if (key == "nodes") {
+            parseNumber(rest, info.nodes);
+        } else if (key == "nps") {
+            parseNumber(rest, info.nps);
+        } else if (key == "time") {
+            parseNumber(rest, info.time);
+        } else if (key == "hashfull") {
+            parseNumber(rest, info.hashfull);
+        } else if (key == "pv") {
+            for (std::string_view move = nextToken(rest); !move.empty() && info.pvLength < MAX_PV;
+                 move = nextToken(rest))
+                copyMove(move, info.pv[info.pvLength++]);
+        } else if (key == "string") {
+            // Free text up to the end of the line
+            event.type = EventType::Other;
+            copyText(rest, event.text);
+            return;
+        }
+        // Anything else, like 'currmove' or bounds, is skipped a word at a time
+    }
+}
+
+/* Turns one line of engine output into an event, returns false for blank lines */
+bool parseLine(std::string_view line, Event& event) {
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    std::string_view rest = line;
+    std::string_view command = nextToken(rest);
+    if (command.empty())
+        return false;
+
+    event.text[0] = '\0';
+    if (command == "info") {
+        event.type = EventType::Info;
+        parseInfo(rest, event);
+    } else if (command == "bestmove") {
+        event.type = EventType::BestMove;
+        copyMove(nextToken(rest), event.bestMove);
+        event.ponderMove[0] = '\0';
+        if (nextToken(rest) == "ponder")
+            copyMove(nextToken(rest), event.ponderMove);
+    } else if (command == "uciok") {
+        event.type = EventType::UciOk;
+    } else if (command == "readyok") {
+        event.type = EventType::ReadyOk;
+    } else if (command == "id") {
+        event.type = EventType::Id;
+        copyText(rest, event.text);
+    } else if (command == "option") {
+        event.type = EventType::Option;
+        copyText(rest, event.text);
+    } else {
+        event.type = EventType::Other;
+        copyText(line, event.text);
+    }
+    return true;
+}
+
+/* Consumer side */
+
+bool Process::poll(Event& event) { return events.pop(event); }
+
+bool Process::wait(Event& event, const int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (!events.pop(event)) {
+        // An engine that died has pushed its last event already
+        if (!alive && !events.pop(event))
+            return false;
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return true;
+}
+
+bool Process::waitFor(const EventType type, Event& event, const int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - std::chrono::steady_clock::now())
+                            .count();
+        if (remaining < 0 || !wait(event, remaining))
+            return false;
+        if (event.type == type)
+            return true;
+    }
+}
+
+#ifdef __linux__
+
+/* Event loop */
+
+struct Manager
+{
+    std::once_flag started;
+    int epollFd = -1;
+    // Written to wake the loop up for shutdown
+    int wakeFd = -1;
+    std::atomic<bool> running = false;
+    std::thread thread;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Process>> processes;
+
+    ~Manager() { shutdown(); }
+    // Returns false if the event loop couldn't be set up
+    bool start();
+    void loop();
+    void shutdown();
+};
+
+Manager manager;
+
+bool Manager::start() {
+    std::call_once(started, [this] {
+        // A write to an engine that died must fail instead of killing us
+        std::signal(SIGPIPE, SIG_IGN);
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (epollFd < 0 || wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) != 0) {
+            std::cerr << "Failed to set up the engine event loop: " << std::strerror(errno) << "\n";
+            if (epollFd >= 0)
+                ::close(epollFd);
+            if (wakeFd >= 0)
+                ::close(wakeFd);
+            return;
+        }
+        running = true;
+        thread = std::thread([this] { loop(); });
+    });
+    return running;
+}
+
+// Pushes an event that mustn't be lost, giving the consumer a moment if its queue is full
+void pushReliably(Process& process, const Event& event) {
+    for (int attempt = 0; attempt < 1000 && !process.events.push(event); attempt++)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+void handleLines(Process& process) {
+    static thread_local Event event;
+    char* begin = process.buffer.data();
+    char* end = begin + process.buffered;
+    char* newline;
+    while ((newline = static_cast<char*>(std::memchr(begin, '\n', end - begin)))) {
+        if (parseLine(std::string_view(begin, newline - begin), event)) {
+            // Infos are superseded by the next one anyway, so they're dropped if nobody reads
+            if (event.type == EventType::Info) {
+                if (!process.events.push(event))
+                    process.droppedInfos++;
+            } else {
+                pushReliably(process, event);
+            }
+        }
+        begin = newline + 1;
+    }
+    process.buffered = end - begin;
+    // A line longer than the whole buffer is cut
+    if (process.buffered == process.buffer.size())
+        process.buffered = 0;
+    std::memmove(process.buffer.data(), begin, process.buffered);
+}
+
+void finish(const int epollFd, Process& process) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, process.output, nullptr);
+    ::close(process.output);
+    process.output = -1;
+    Event event;
+    event.type = EventType::Exited;
+    pushReliably(process, event);
+    process.alive = false;
+}
+
+void Manager::loop() {
+    std::array<epoll_event, 64> ready;
+    while (running) {
+        int count = epoll_wait(epollFd, ready.data(), ready.size(), -1);
+        for (int i = 0; i < count; i++) {
+            Process* process = static_cast<Process*>(ready[i].data.ptr);
+            if (!process) {
+                uint64_t value;
+                [[maybe_unused]] ssize_t result = read(wakeFd, &value, sizeof(value));
+                continue;
+            }
+            // Drain everything available, the descriptor is non-blocking
+            while (true) {
+                ssize_t bytes = read(process->output, process->buffer.data() + process->buffered,
+                                     process->buffer.size() - process->buffered);
+                if (bytes > 0) {
+                    process->buffered += bytes;
+                    handleLines(*process);
+                } else if (bytes < 0 && errno == EINTR) {
+                    continue;
+                } else {
+                    if (bytes == 0 || errno != EAGAIN)
+                        finish(epollFd, *process);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void Manager::shutdown() {
+    if (!running)
+        return;
+    std::vector<Process*> open;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& process : processes)
+            open.push_back(process.get());
+    }
+    for (Process* process : open)
+        close(process);
+    running = false;
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t result = write(wakeFd, &one, sizeof(one));
+    thread.join();
+    ::close(epollFd);
+    ::close(wakeFd);
+}
+
+/* Looks a command up in PATH the way execvp would. It's done before forking because execvp
+   isn't async-signal-safe, it may allocate while searching */
+std::string findExecutable(const std::string& path) {
+    const char* searchPath = std::getenv("PATH");
+    if (path.find('/') != std::string::npos || !searchPath)
+        return path;
+    std::string_view dirs = searchPath;
+    while (true) {
+        size_t end = std::min(dirs.find(':'), dirs.size());
+        // An empty entry means the current directory
+        std::string dir(end == 0 ? "." : dirs.substr(0, end));
+        std::string candidate = dir + "/" + path;
+        if (access(candidate.c_str(), X_OK) == 0)
+            return candidate;
+        if (end == dirs.size())
+            return path;
+        dirs.remove_prefix(end + 1);
+    }
+}
+
+/* Starts an engine, returns null if it couldn't be started */
+Process* spawn(const std::string& path, const std::vector<std::string>& args) {
+    if (!manager.start())
+        return nullptr;
+    int toEngine[2], fromEngine[2];
+    // Close on exec, so engines don't inherit each other's pipes and miss an EOF
+    if (pipe2(toEngine, O_CLOEXEC) != 0)
+        return nullptr;
+    if (pipe2(fromEngine, O_CLOEXEC) != 0) {
+        ::close(toEngine[0]);
+        ::close(toEngine[1]);
+        return nullptr;
+    }
+    // Built before forking, the child may only make async-signal-safe calls: dup2, execve and
+    // _exit
+    std::string executable = findExecutable(path);
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(path.c_str()));
+    for (const std::string& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    int pid = fork();
+    if (pid == 0) {
+        dup2(toEngine[0], STDIN_FILENO);
+        dup2(fromEngine[1], STDOUT_FILENO);
+        execve(executable.c_str(), argv.data(), environ);
+        _exit(127);
+    }
+    ::close(toEngine[0]);
+    ::close(fromEngine[1]);
+    if (pid < 0) {
+        ::close(toEngine[1]);
+        ::close(fromEngine[0]);
+        return nullptr;
+    }
+    fcntl(fromEngine[0], F_SETFL, fcntl(fromEngine[0], F_GETFL) | O_NONBLOCK);
+
+    auto process = std::make_unique<Process>();
+    process->pid = pid;
+    process->input = toEngine[1];
+    process->output = fromEngine[0];
+    process->alive = true;
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = process.get();
+    // Without the loop watching it, the engine's output would never be read
+    if (epoll_ctl(manager.epollFd, EPOLL_CTL_ADD, process->output, &event) != 0) {
+        std::cerr << "Failed to watch '" << path << "': " << std::strerror(errno) << "\n";
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        ::close(toEngine[1]);
+        ::close(fromEngine[0]);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(manager.mutex);
+    manager.processes.push_back(std::move(process));
+    return manager.processes.back().get();
+}
+
+bool Process::send(std::string_view command) {
+    if (input < 0)
+        return false;
+    std::string line(command);
+    line += '\n';
+    size_t written = 0;
+    while (written < line.size()) {
+        ssize_t bytes = write(input, line.data() + written, line.size() - written);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return false;
+        written += bytes;
+    }
+    return true;
+}
+
+/* Asks the engine to quit, kills it if it doesn't, and frees it */
+void close(Process* process) {
+    if (!process)
+        return;
+    if (process->alive) {
+        process->send("quit");
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1000);
+        while (process->alive && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (process->alive)
+            kill(process->pid, SIGKILL);
+        // The event loop sees the pipe close once the process is gone
+        while (process->alive)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ::close(process->input);
+    waitpid(process->pid, nullptr, 0);
+
+    std::lock_guard<std::mutex> lock(manager.mutex);
+    auto& processes = manager.processes;
+    processes.erase(std::remove_if(processes.begin(), processes.end(),
+                                   [&](auto& owned) { return owned.get() == process; }),
+                    processes.end());
+}
+
+void shutdown() { manager.shutdown(); }
+
+#else
+
+// Only Linux has epoll, elsewhere no engine can be started
+Process* spawn(const std::string& path, const std::vector<std::string>&) {
+    std::cerr << "Failed to start '" << path << "': external engines need Linux\n";
+    return nullptr;
+}
+bool Process::send(std::string_view) { return false; }
+void close(Process*) {}
+void shutdown() {}
+
+#endif
+
+/* Drives an engine through a short session and checks every reply, 'enginePath' is normally
+   this binary itself */
+void test(const std::string& enginePath) {
+    int failures = 0;
+    auto check = [&](bool ok, const char* what) {
+        if (!ok) {
+            std::cout << "Engine test failed: " << what << "\n";
+            failures++;
+        }
+        return ok;
+    };
+
+    Process* engine = spawn(enginePath);
+    if (!check(engine != nullptr, "spawn"))
+        return;
+    Event event;
+    engine->send("uci");
+    check(engine->waitFor(EventType::UciOk, event, 2000), "uciok");
+    engine->send("isready");
+    check(engine->waitFor(EventType::ReadyOk, event, 2000), "readyok");
+
+    engine->send("position startpos moves e2e4");
+    engine->send("go depth 8");
+    int lastDepth = 0, infos = 0;
+    while (engine->wait(event, 10000) && event.type != EventType::BestMove) {
+        if (event.type == EventType::Info && event.info.pvLength > 0) {
+            check(event.info.depth >= lastDepth && event.info.hasScore, "info order");
+            lastDepth = event.info.depth;
+            infos++;
+        }
+    }
+    check(event.type == EventType::BestMove && std::strlen(event.bestMove.data()) >= 4,
+          "bestmove");
+    check(lastDepth == 8 && infos >= 8, "info depths");
+
+    // 'stop' has to end an infinite search promptly
+    engine->send("go infinite");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto stopTime = std::chrono::steady_clock::now();
+    engine->send("stop");
+    check(engine->waitFor(EventType::BestMove, event, 1000), "stop");
+    long long latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - stopTime)
+                            .count();
+
+    engine->send("quit");
+    check(engine->waitFor(EventType::Exited, event, 2000), "exit");
+    close(engine);
+    std::cout << "Engine test: " << failures << " failures, stop latency " << latency << "us\n";
+}
+
+} // namespace Engines
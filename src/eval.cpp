@@ -0,0 +1,139 @@
+#include "eval.hpp"
+
+#include <algorithm>
+
+#include "bitboard.hpp"
+#include "eval_constants.hpp"
+#include "move.hpp"
+#include "zobrist.hpp"
+
+namespace Eval {
+
+// Material values in centipawns, indexed by piece type
+const std::array<int, 6> pieceValue = {100, 320, 330, 500, 900, 0};
+
+// Black's entries are white's mirrored vertically and negated, so a position and its colour
+// flipped twin always get opposite sums
+const std::array<std::array<int, 64>, 12> mgTable = [] {
+    std::array<std::array<int, 64>, 12> table{};
+    for (int type = 0; type < 6; type++) {
+        for (int sq = 0; sq < 64; sq++) {
+            table[type][sq] = mgPieceValue[type] + mgPieceTable[type][sq];
+            table[type + 6][sq] = -(mgPieceValue[type] + mgPieceTable[type][FLIP(sq)]);
+        }
+    }
+    return table;
+}();
+
+const std::array<std::array<int, 64>, 12> egTable = [] {
+    std::array<std::array<int, 64>, 12> table{};
+    for (int type = 0; type < 6; type++) {
+        for (int sq = 0; sq < 64; sq++) {
+            table[type][sq] = egPieceValue[type] + egPieceTable[type][sq];
+            table[type + 6][sq] = -(egPieceValue[type] + egPieceTable[type][FLIP(sq)]);
+        }
+    }
+    return table;
+}();
+
+const std::array<int, 12> phaseTable = [] {
+    std::array<int, 12> table{};
+    for (int type = 0; type < 6; type++)
+        table[type] = table[type + 6] = phaseWeight[type];
+    return table;
+}();
+
+/* Recomputes the incrementally updated terms from scratch */
+void refresh(Board& board) {
+    board.state.mgScore = board.state.egScore = board.state.phase = 0;
+    for (int piece = (int)Piece::P; piece <= (int)Piece::k; piece++) {
+        uint64_t bitboard = board.pos.pieces[piece];
+        while (bitboard) {
+            int sq = Bitboard::lsbIndex(bitboard);
+            board.state.mgScore += mgTable[piece][sq];
+            board.state.egScore += egTable[piece][sq];
+            board.state.phase += phaseTable[piece];
+            popBit(bitboard, sq);
+        }
+    }
+    if (NNUE::loaded)
+        NNUE::refresh(board.accumulator, board);
+}
+
+/* Returns a static evaluation of the position from the side to move's point of view. The
+   midgame and endgame scores are blended by the game phase, unless a network is loaded */
+int evaluate(const Board& board) {
+    if (NNUE::loaded)
+        return NNUE::evaluate(board.accumulator, board.state.side);
+    int phase = std::min(board.state.phase, MAX_PHASE);
+    int score =
+        (board.state.mgScore * phase + board.state.egScore * (MAX_PHASE - phase)) / MAX_PHASE;
+    return board.state.side == PieceColor::LIGHT ? score : -score;
+}
+
+/* Allocated by the thread that uses it, so the memory is local to that thread's node */
+void Cache::allocate() {
+    entries.assign(SIZE, 0ULL);
+}
+
+/* Returns the position with the board flipped vertically and the colours swapped */
+Board mirror(const Board& board) {
+    Board mirrored = board;
+    for (int piece = 0; piece < 12; piece++) {
+        uint64_t flipped = 0ULL;
+        uint64_t bitboard = board.pos.pieces[piece];
+        while (bitboard) {
+            int sq = Bitboard::lsbIndex(bitboard);
+            setBit(flipped, FLIP(sq));
+            popBit(bitboard, sq);
+        }
+        mirrored.pos.pieces[(piece + 6) % 12] = flipped;
+    }
+    mirrored.pos.updateUnits();
+    mirrored.state.side = board.state.xside;
+    mirrored.state.xside = board.state.side;
+    mirrored.state.enpassant =
+        board.state.enpassant == Sq::noSq ? Sq::noSq : (Sq)FLIP(board.state.enpassant);
+    // White's rights are the low two bits and black's the high two
+    mirrored.state.castling = ((board.state.castling & 3) << 2) | (board.state.castling >> 2);
+    mirrored.state.key = Zobrist::generate(mirrored);
+    refresh(mirrored);
+    return mirrored;
+}
+
+/* Checks over the standard positions and every position one move away from them that the
+   incrementally updated terms match a full refresh and that the evaluation is colour symmetric */
+void test() {
+    int positions = 0, failures = 0;
+    auto check = [&](const Board& board) {
+        Board refreshed = board;
+        refresh(refreshed);
+        bool incremental = refreshed.state.mgScore == board.state.mgScore &&
+                           refreshed.state.egScore == board.state.egScore &&
+                           refreshed.state.phase == board.state.phase &&
+                           (!NNUE::loaded ||
+                            refreshed.accumulator.values == board.accumulator.values);
+        bool symmetric = evaluate(board) == evaluate(mirror(board));
+        positions++;
+        if (!incremental || !symmetric) {
+            failures++;
+            std::cout << (incremental ? "Asymmetric" : "Incremental mismatch") << " evaluation:";
+            board.display();
+        }
+    };
+
+    for (size_t i = 1; i < Board::position.size(); i++) {
+        Board board(Board::position[i]);
+        check(board);
+        Move::MoveList moveList;
+        Move::generate(moveList, board);
+        for (int j = 0; j < moveList.count; j++) {
+            Board child = board;
+            if (Move::make(&child, moveList.list[j], Move::MoveType::allMoves))
+                check(child);
+        }
+    }
+    std::cout << "Evaluation test: " << failures << " failures in " << positions << " positions\n";
+}
+
+} // namespace Eval
@@ -0,0 +1,526 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "attack.hpp"
+#include "bitboard.hpp"
+#include "gamedb.hpp"
+#include "magics.hpp"
+#include "move.hpp"
+#include "search.hpp"
+
+namespace GameDB {
+
+/* The file is the header followed by these sections, each an array in host byte order:
+     uint64 offsets[games + 1]            where each game's moves start in 'moves'
+     uint32 columns[ColumnCount][games]   string ids, 0 is the empty string
+     uint32 stringOffsets[strings + 1]
+     int8   results[games]                GameResult
+     char   stringData[stringBytes]
+     uint8  moves[moveBytes]
+   The wider arrays come first so every one of them is aligned in the mapping */
+struct FileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t games;
+    uint64_t moveBytes;
+    uint32_t strings;
+    uint32_t stringBytes;
+};
+
+constexpr char MAGIC[4] = {'C', 'G', 'D', 'B'};
+constexpr uint32_t VERSION = 2;
+
+/* The legal moves of a position in database order: by piece from pawn to king, then source
+   square, then target square, then promotion piece from knight to queen. Each piece's legal
+   targets form one bitboard, so a move's index is a sum of bit counts. Only the king, pinned
+   pieces, en passant and positions in check need their targets tried one at a time */
+struct MoveOrder
+{
+    const Board& board;
+    bool white;
+    // The side to move's pawn, the other pieces follow it
+    int first;
+    uint64_t own, enemies, occupancy;
+    // Pieces standing between their king and an enemy slider, possibly a few more
+    uint64_t pinned = 0;
+    bool inCheck;
+
+    MoveOrder(const Board& board);
+    bool promotes(const int piece, const int source) const;
+    uint64_t targets(const int piece, const int source) const;
+    int move(const int piece, const int source, const int target, const int promoted) const;
+};
+
+constexpr Piece PROMOTIONS[4] = {Piece::N, Piece::B, Piece::R, Piece::Q};
+
+MoveOrder::MoveOrder(const Board& board) : board(board) {
+    white = board.state.side == PieceColor::LIGHT;
+    first = white ? (int)Piece::P : (int)Piece::p;
+    own = board.pos.units[(int)board.state.side];
+    enemies = board.pos.units[(int)board.state.xside];
+    occupancy = board.pos.units[(int)PieceColor::BOTH];
+
+    int them = white ? 6 : 0;
+    auto enemy = [&](Piece piece) { return board.pos.pieces[(int)piece + them]; };
+    int kingSq = Bitboard::lsbIndex(board.pos.pieces[first + (int)PieceTypes::KING]);
+    uint64_t diagonal = enemy(Piece::B) | enemy(Piece::Q);
+    uint64_t straight = enemy(Piece::R) | enemy(Piece::Q);
+    inCheck = (Attack::pawnAttacks[(int)board.state.side][kingSq] & enemy(Piece::P)) ||
+              (Attack::knightAttacks[kingSq] & enemy(Piece::N)) ||
+              (Magics::getBishopAttack(kingSq, occupancy) & diagonal) ||
+              (Magics::getRookAttack(kingSq, occupancy) & straight);
+
+    // Nothing can be pinned without a slider on one of the king's lines
+    if (!(Magics::getBishopAttack(kingSq, 0) & diagonal) &&
+        !(Magics::getRookAttack(kingSq, 0) & straight))
+        return;
+    uint64_t candidates = Magics::getQueenAttack(kingSq, occupancy) & own;
+    while (candidates) {
+        int sq = Bitboard::lsbIndex(candidates);
+        popBit(candidates, sq);
+        uint64_t without = occupancy & ~(1ULL << sq);
+        if ((Magics::getBishopAttack(kingSq, without) & diagonal) ||
+            (Magics::getRookAttack(kingSq, without) & straight))
+            pinned |= 1ULL << sq;
+    }
+}
+
+bool MoveOrder::promotes(const int piece, const int source) const {
+    return piece == first && ROW(source) == (white ? 1 : 6);
+}
+
+uint64_t MoveOrder::targets(const int piece, const int source) const {
+    uint64_t targets = 0;
+    bool tryEach = inCheck || getBit(pinned, source);
+    switch ((PieceTypes)(piece - first)) {
+    case PieceTypes::PAWN: {
+        int push = white ? source - 8 : source + 8;
+        if (!getBit(occupancy, push)) {
+            targets |= 1ULL << push;
+            int doublePush = white ? source - 16 : source + 16;
+            if (ROW(source) == (white ? 6 : 1) && !getBit(occupancy, doublePush))
+                targets |= 1ULL << doublePush;
+        }
+        uint64_t attacks = Attack::pawnAttacks[(int)board.state.side][source];
+        targets |= attacks & enemies;
+        if (board.state.enpassant != Sq::noSq && getBit(attacks, (int)board.state.enpassant)) {
+            targets |= 1ULL << (int)board.state.enpassant;
+            // Taking en passant clears two squares of a rank, which can expose the king
+            tryEach = true;
+        }
+        break;
+    }
+    case PieceTypes::KNIGHT:
+        targets = Attack::knightAttacks[source] & ~own;
+        break;
+    case PieceTypes::BISHOP:
+        targets = Magics::getBishopAttack(source, occupancy) & ~own;
+        break;
+    case PieceTypes::ROOK:
+        targets = Magics::getRookAttack(source, occupancy) & ~own;
+        break;
+    case PieceTypes::QUEEN:
+        targets = Magics::getQueenAttack(source, occupancy) & ~own;
+        break;
+    default: {
+        targets = Attack::kingAttacks[source] & ~own;
+        tryEach = true;
+        if (board.state.castling && !inCheck) {
+            Move::MoveList castling;
+            if (white)
+                Move::genWhiteCastling(castling, board);
+            else
+                Move::genBlackCastling(castling, board);
+            for (int i = 0; i < castling.count; i++)
+                targets |= 1ULL << Move::getTarget(castling.list[i]);
+        }
+        break;
+    }
+    }
+    if (!tryEach)
+        return targets;
+
+    uint64_t legal = 0;
+    for (uint64_t rest = targets; rest;) {
+        int target = Bitboard::lsbIndex(rest);
+        popBit(rest, target);
+        if (Move::isLegal(board, move(piece, source, target, (int)Piece::E)))
+            legal |= 1ULL << target;
+    }
+    return legal;
+}
+
+// Flagged the way the move generator flags it
+int MoveOrder::move(const int piece, const int source, const int target,
+                    const int promoted) const {
+    bool pawn = piece == first;
+    bool enpassant = pawn && target == (int)board.state.enpassant;
+    bool capture = getBit(enemies, target) || enpassant;
+    bool twoSquarePush = pawn && std::abs(target - source) == 16;
+    bool castling = piece == first + (int)PieceTypes::KING && std::abs(target - source) == 2;
+    return Move::encode(source, target, piece, promoted, capture, twoSquarePush, enpassant,
+                        castling);
+}
+
+int encodeMove(const Board& board, const int move) {
+    MoveOrder order(board);
+    int piece = Move::getPiece(move), source = Move::getSource(move);
+    int target = Move::getTarget(move), promoted = Move::getPromoted(move);
+    if (piece < order.first || piece >= order.first + 6 || !getBit(board.pos.pieces[piece], source))
+        return -1;
+
+    int index = 0;
+    for (int other = order.first; other <= piece; other++) {
+        uint64_t pieces = board.pos.pieces[other];
+        if (other == piece)
+            pieces &= (1ULL << source) - 1;
+        while (pieces) {
+            int sq = Bitboard::lsbIndex(pieces);
+            popBit(pieces, sq);
+            index += Bitboard::countBits(order.targets(other, sq)) *
+                     (order.promotes(other, sq) ? 4 : 1);
+        }
+    }
+    uint64_t targets = order.targets(piece, source);
+    if (!getBit(targets, target))
+        return -1;
+
+    int before = Bitboard::countBits(targets & ((1ULL << target) - 1));
+    if (order.promotes(piece, source)) {
+        const Piece* found = std::find(PROMOTIONS, PROMOTIONS + 4, (Piece)(promoted % 6));
+        if (promoted == (int)Piece::E || found == PROMOTIONS + 4)
+            return -1;
+        index += before * 4 + (found - PROMOTIONS);
+    } else {
+        index += before;
+    }
+    return order.move(piece, source, target, promoted) == move ? index : -1;
+}
+
+int decodeMove(const Board& board, int index) {
+    MoveOrder order(board);
+    for (int piece = order.first; piece < order.first + 6; piece++) {
+        for (uint64_t pieces = board.pos.pieces[piece]; pieces;) {
+            int source = Bitboard::lsbIndex(pieces);
+            popBit(pieces, source);
+            uint64_t targets = order.targets(piece, source);
+            int width = order.promotes(piece, source) ? 4 : 1;
+            int count = Bitboard::countBits(targets) * width;
+            if (index >= count) {
+                index -= count;
+                continue;
+            }
+            for (int skip = index / width; skip > 0; skip--)
+                targets &= targets - 1;
+            int promoted = (int)Piece::E;
+            if (width == 4)
+                promoted = (int)PROMOTIONS[index % 4] + (order.white ? 0 : 6);
+            return order.move(piece, source, Bitboard::lsbIndex(targets), promoted);
+        }
+    }
+    return 0;
+}
+
+Writer::Writer() {
+    intern("");
+    offsets.push_back(0);
+}
+
+uint32_t Writer::intern(const std::string& text) {
+    auto [it, added] = stringIds.try_emplace(text, (uint32_t)strings.size());
+    if (added)
+        strings.push_back(text);
+    return it->second;
+}
+
+void Writer::add(const PGNInfo& game) {
+    const PGNHeader& header = game.header;
+    columns[Event].push_back(intern(header.event));
+    columns[Site].push_back(intern(header.site));
+    columns[Date].push_back(intern(header.date));
+    columns[Round].push_back(intern(header.round));
+    columns[White].push_back(intern(header.players[0]));
+    columns[Black].push_back(intern(header.players[1]));
+    columns[Fen].push_back(intern(header.fen));
+    results.push_back((int8_t)header.result);
+
+    Board board(header.fen.empty() ? Board::position[1] : header.fen);
+    for (int move : game.moves) {
+        int index = encodeMove(board, move);
+        // PGNInfo only holds legal moves, so this can't happen unless it was built by hand
+        if (index < 0)
+            break;
+        moveData.push_back((uint8_t)index);
+        Move::make(&board, move, Move::MoveType::allMoves);
+    }
+    offsets.push_back(moveData.size());
+}
+
+template <typename T>
+void writeArray(std::ofstream& file, const std::vector<T>& values) {
+    file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+bool Writer::write(const std::string& path) const {
+    std::vector<uint32_t> stringOffsets = {0};
+    std::string stringData;
+    for (const std::string& text : strings) {
+        stringData += text;
+        stringOffsets.push_back(stringData.size());
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.games = size();
+    header.moveBytes = moveData.size();
+    header.strings = strings.size();
+    header.stringBytes = stringData.size();
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeArray(file, offsets);
+    for (const std::vector<uint32_t>& column : columns)
+        writeArray(file, column);
+    writeArray(file, stringOffsets);
+    writeArray(file, results);
+    file.write(stringData.data(), stringData.size());
+    writeArray(file, moveData);
+    return (bool)file;
+}
+
+bool Database::open(const std::string& path) {
+    games = 0;
+    FileHeader header;
+    if (!file.open(path) || file.size < sizeof(FileHeader)) {
+        std::cerr << "Failed to open game database '" << path << "'\n";
+        return false;
+    }
+    std::memcpy(&header, file.data, sizeof(FileHeader));
+    // Counts beyond the file's size would overflow the expected size below
+    bool fits = header.games < file.size && header.moveBytes <= file.size;
+    uint64_t expected = sizeof(FileHeader) + (header.games + 1) * sizeof(uint64_t) +
+                        header.games * (ColumnCount * sizeof(uint32_t) + 1) +
+                        (header.strings + 1ULL) * sizeof(uint32_t) + header.stringBytes +
+                        header.moveBytes;
+    if (std::memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION || !fits ||
+        file.size != expected) {
+        std::cerr << "'" << path << "' isn't a compatible game database\n";
+        file.close();
+        return false;
+    }
+
+    const char* data = file.data + sizeof(FileHeader);
+    auto take = [&](const size_t bytes) {
+        const char* section = data;
+        data += bytes;
+        return section;
+    };
+    games = header.games;
+    offsets = reinterpret_cast<const uint64_t*>(take((games + 1) * sizeof(uint64_t)));
+    for (const uint32_t*& column : columns)
+        column = reinterpret_cast<const uint32_t*>(take(games * sizeof(uint32_t)));
+    stringCount = header.strings;
+    stringOffsets = reinterpret_cast<const uint32_t*>(take((stringCount + 1) * sizeof(uint32_t)));
+    results = reinterpret_cast<const int8_t*>(take(games));
+    stringData = take(header.stringBytes);
+    moveData = reinterpret_cast<const uint8_t*>(take(header.moveBytes));
+
+    // Offsets have to run in order from the start to the end of their section, so no game or
+    // string reaches outside of it
+    bool valid = offsets[0] == 0 && offsets[games] == header.moveBytes &&
+                 stringOffsets[0] == 0 && stringOffsets[stringCount] == header.stringBytes;
+    for (size_t game = 0; valid && game < games; game++) {
+        valid = offsets[game] <= offsets[game + 1] && results[game] >= (int)GameResult::BlackWin &&
+                results[game] <= (int)GameResult::InProgress;
+    }
+    for (uint32_t id = 0; valid && id < stringCount; id++)
+        valid = stringOffsets[id] <= stringOffsets[id + 1];
+    if (!valid) {
+        std::cerr << "'" << path << "' is corrupt\n";
+        games = 0;
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+std::string_view Database::string(const uint32_t id) const {
+    if (id >= stringCount)
+        return {};
+    return std::string_view(stringData + stringOffsets[id],
+                            stringOffsets[id + 1] - stringOffsets[id]);
+}
+
+PGNHeader Database::header(const size_t game) const {
+    PGNHeader header;
+    header.event = string(columns[Event][game]);
+    header.site = string(columns[Site][game]);
+    header.date = string(columns[Date][game]);
+    header.round = string(columns[Round][game]);
+    header.players[0] = string(columns[White][game]);
+    header.players[1] = string(columns[Black][game]);
+    header.fen = string(columns[Fen][game]);
+    header.result = (GameResult)results[game];
+    return header;
+}
+
+std::vector<int> Database::moves(const size_t game) const {
+    std::string_view fen = string(columns[Fen][game]);
+    Board board(fen.empty() ? Board::position[1] : std::string(fen));
+    std::vector<int> moves;
+    moves.reserve(length(game));
+    for (uint64_t i = offsets[game]; i < offsets[game + 1]; i++) {
+        int move = decodeMove(board, moveData[i]);
+        if (!move)
+            return {};
+        moves.push_back(move);
+        Move::make(&board, move, Move::MoveType::allMoves);
+    }
+    return moves;
+}
+
+std::string resultString(const GameResult result) {
+    switch (result) {
+    case GameResult::WhiteWin:
+        return "1-0";
+    case GameResult::BlackWin:
+        return "0-1";
+    case GameResult::Draw:
+        return "1/2-1/2";
+    default:
+        return "*";
+    }
+}
+
+/* The seven tag roster plus the start position, with SAN movetext kept under 80 columns */
+void writeGame(std::ostream& out, const PGNHeader& header, const std::vector<int>& moves) {
+    auto tag = [&](const char* name, const std::string& value) {
+        out << "[" << name << " \"" << (value.empty() ? "?" : value) << "\"]\n";
+    };
+    std::string result = resultString(header.result);
+    tag("Event", header.event);
+    tag("Site", header.site);
+    tag("Date", header.date.empty() ? "????.??.??" : header.date);
+    tag("Round", header.round);
+    tag("White", header.players[0]);
+    tag("Black", header.players[1]);
+    tag("Result", result);
+    if (!header.fen.empty()) {
+        tag("FEN", header.fen);
+        tag("SetUp", "1");
+    }
+    out << "\n";
+
+    const Board start(header.fen.empty() ? Board::position[1] : header.fen);
+    Board board = start;
+    std::vector<std::string> san;
+    for (int move : moves) {
+        san.push_back(Move::toSAN(move, board));
+        Move::make(&board, move, Move::MoveType::allMoves);
+    }
+    PGN::writeMovetext(out, start, san, {}, result);
+}
+
+/* Encodes every move of the test games and decodes it again, then writes the games to a
+   temporary database and reads them back */
+void test() {
+    const char* files[] = {"tests/test_pgn_fischer.txt", "tests/test_pgn_with_comments.txt",
+                           "tests/test_pgn_without_comments.txt", "tests/test_random_pgn.txt"};
+    std::vector<PGNInfo> games;
+    int moves = 0, failures = 0;
+    Writer writer;
+    for (const char* path : files) {
+        PGN::Reader reader;
+        if (!reader.open(path)) {
+            failures++;
+            continue;
+        }
+        PGN::Game game;
+        while (reader.next(game)) {
+            games.emplace_back(game);
+            const std::string& fen = games.back().header.fen;
+            Board board(fen.empty() ? Board::position[1] : fen);
+            for (int move : games.back().moves) {
+                if (decodeMove(board, encodeMove(board, move)) != move)
+                    failures++;
+                Move::make(&board, move, Move::MoveType::allMoves);
+                moves++;
+            }
+            writer.add(games.back());
+        }
+    }
+
+    std::string path = (std::filesystem::temp_directory_path() / "cegui_test.cgdb").string();
+    Database db;
+    if (!writer.write(path) || !db.open(path) || db.size() != games.size()) {
+        failures++;
+    } else {
+        for (size_t i = 0; i < games.size(); i++) {
+            const PGNHeader& expected = games[i].header;
+            PGNHeader header = db.header(i);
+            if (header.event != expected.event || header.date != expected.date ||
+                header.players[0] != expected.players[0] ||
+                header.players[1] != expected.players[1] || header.round != expected.round ||
+                header.result != expected.result || db.moves(i) != games[i].moves)
+                failures++;
+        }
+    }
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    std::cout << "GameDB test: " << failures << " failures in " << games.size() << " games, "
+              << moves << " moves\n";
+}
+
+long long fromPGN(const std::string& pgnPath, const std::string& dbPath) {
+    long long start = Search::now();
+    Writer writer;
+    long long skipped = 0;
+    // The sink runs one game at a time in file order, so the writer needs no lock
+    long long games = PGN::import(pgnPath, [&](const PGNInfo& game, const int) {
+        if (game.valid)
+            writer.add(game);
+        else
+            skipped++;
+    });
+    if (games < 0) {
+        std::cerr << "Failed to read '" << pgnPath << "'\n";
+        return -1;
+    }
+    if (!writer.write(dbPath)) {
+        std::cerr << "Failed to write '" << dbPath << "'\n";
+        return -1;
+    }
+
+    std::error_code error;
+    double pgnSize = std::filesystem::file_size(pgnPath, error);
+    double dbSize = std::filesystem::file_size(dbPath, error);
+    printf("Converted %zu games in %lld ms, %.1f MB of PGN to %.1f MB (%.1fx smaller)\n",
+           writer.size(), Search::now() - start, pgnSize / 1e6, dbSize / 1e6,
+           pgnSize / std::max(1.0, dbSize));
+    if (skipped)
+        printf("Left out %lld games with moves that couldn't be read\n", skipped);
+    return writer.size();
+}
+
+long long toPGN(const std::string& dbPath, const std::string& pgnPath) {
+    long long start = Search::now();
+    Database db;
+    if (!db.open(dbPath))
+        return -1;
+    std::ofstream out(pgnPath);
+    for (size_t game = 0; game < db.size(); game++)
+        writeGame(out, db.header(game), db.moves(game));
+    if (!out) {
+        std::cerr << "Failed to write '" << pgnPath << "'\n";
+        return -1;
+    }
+    printf("Converted %zu games in %lld ms\n", db.size(), Search::now() - start);
+    return db.size();
+}
+
+} // namespace GameDB
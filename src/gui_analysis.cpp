@@ -0,0 +1,126 @@
+#include "gui_analysis.hpp"
+
+#include "move.hpp"
+#include "options.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+const int ANALYSIS_LINES = 3;
+
+Analysis::Analysis(const std::string& enginePath) {
+    if (!enginePath.empty()) {
+        engine = Engines::spawn(enginePath);
+        Engines::Event event;
+        if (engine && engine->send("uci") && engine->waitFor(Engines::EventType::UciOk, event, 2000)) {
+            engine->send("setoption name MultiPV value " + std::to_string(ANALYSIS_LINES));
+            return;
+        }
+        std::cout << "Failed to start '" << enginePath << "', using the built-in search\n";
+        Engines::close(engine);
+        engine = nullptr;
+    }
+    Options::set("MultiPV", std::to_string(ANALYSIS_LINES));
+    Search::silent = true;
+    Search::onInfo = [this](const Search::Info& info) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // A new depth starts over with its first line
+        if (info.multipv == 1)
+            lines.clear();
+        lines.push_back(info);
+    };
+}
+
+Analysis::~Analysis() {
+    stop();
+    if (engine)
+        Engines::close(engine);
+    else
+        Search::onInfo = nullptr;
+}
+
+void Analysis::start(const Board& board) {
+    stop();
+    if (engine) {
+        std::lock_guard<std::mutex> lock(mutex);
+        lines.clear();
+        this->board = board;
+        engine->send("position fen " + board.toFen());
+        engine->send("go infinite");
+        engineSearching = true;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lines.clear();
+    }
+    running = true;
+    thread = std::thread([this, board] {
+        Search::Limits limits;
+        limits.infinite = true;
+        Search::search(board, limits);
+        running = false;
+    });
+}
+
+void Analysis::stop() {
+    if (engine) {
+        // Lines still in flight belong to the old position, they're skipped with the rest
+        Engines::Event event;
+        if (engineSearching) {
+            engine->send("stop");
+            engine->waitFor(Engines::EventType::BestMove, event, 1000);
+        }
+        engineSearching = false;
+        return;
+    }
+    if (!thread.joinable())
+        return;
+    // The search clears the stop flag when it starts, so keep raising it until it has ended
+    while (running) {
+        Search::stop();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    thread.join();
+}
+
+// Turns the external engine's reports into the lines the built-in search would have given
+void Analysis::drainEngine() {
+    Engines::Event event;
+    while (engine->poll(event)) {
+        if (event.type != Engines::EventType::Info || !event.info.hasScore ||
+            event.info.pvLength == 0)
+            continue;
+        const Engines::Info& info = event.info;
+        Search::Info line;
+        line.depth = info.depth;
+        line.multipv = info.multipv;
+        line.nodes = info.nodes;
+        line.time = info.time;
+        line.hashfull = info.hashfull;
+        // Mate in n moves is 2n - 1 plies away, mated in n is 2n
+        if (info.mate)
+            line.score = info.score > 0 ? Search::MATE_VALUE - (2 * info.score - 1)
+                                        : -Search::MATE_VALUE - 2 * info.score;
+        else
+            line.score = info.score;
+        Board pvBoard = board;
+        for (int i = 0; i < info.pvLength; i++) {
+            int move = Move::parse(info.pv[i].data(), pvBoard);
+            if (!move || !Move::make(&pvBoard, move, Move::MoveType::allMoves))
+                break;
+            line.pv.push_back(move);
+        }
+        if (line.multipv == 1)
+            lines.clear();
+        lines.push_back(line);
+    }
+}
+
+std::vector<Search::Info> Analysis::getLines() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (engine)
+        drainEngine();
+    return lines;
+}
@@ -1,7 +1,9 @@
 #include "board.hpp"
 #include "defs.hpp"
+#include "gui_analysis.hpp"
 #include "gui_board.hpp"
 #include "gui_defs.hpp"
+#include "tablebase.hpp"
 #include "raylib.h"
 #include <algorithm>
 #include <cmath>
@@ -118,11 +120,29 @@ void drawPromotedChoices(const GUIBoard& gb, const Texture& tex) {
 
 const int EVAL_FONT_SIZE = 15;
 
-void drawEvalBar(const GUIBoard& gb, const Font& font) {
-    float currEval = 0.0f;
+// Scores are reported from the side to move's point of view, the GUI shows them from white's
+int whiteScore(const GUIBoard& gb, const Search::Info& info) {
+    return gb.board.state.side == PieceColor::LIGHT ? info.score : -info.score;
+}
+
+std::string formatScore(int score) {
+    char temp[16] = {0};
+    if (score >= Search::MATE_SCORE)
+        sprintf(temp, "M%d", (Search::MATE_VALUE - score + 1) / 2);
+    else if (score <= -Search::MATE_SCORE)
+        sprintf(temp, "-M%d", (Search::MATE_VALUE + score) / 2);
+    else
+        sprintf(temp, "%.1f", score / 100.0f);
+    return temp;
+}
+
+void drawEvalBar(const GUIBoard& gb, const Font& font, const std::vector<Search::Info>& lines) {
+    int currEval = lines.empty() ? 0 : whiteScore(gb, lines[0]);
     Vector2 evalBarDim = {35.0f, gb.boardRect.height};
-    float whiteHeight = evalBarDim.y / 2.0f;
-    float blackHeight = evalBarDim.y / 2.0f;
+    // The bar fills up linearly until one side is ahead by 8 pawns
+    float whiteShare = 0.5f + std::clamp(currEval / 1600.0f, -0.5f, 0.5f);
+    float whiteHeight = evalBarDim.y * whiteShare;
+    float blackHeight = evalBarDim.y - whiteHeight;
     Rectangle wr = {(gb.boardRect.x / 2.0f) - (evalBarDim.x / 2.0f),
                     ((SCREEN_HEIGHT - evalBarDim.y) / 2.0f) + blackHeight, evalBarDim.x,
                     whiteHeight};
@@ -134,11 +154,9 @@ void drawEvalBar(const GUIBoard& gb, const Font& font) {
     DrawRectangleRec(br, BLACK_EVAL_COLOR);
 
     std::string str;
-    char temp[10] = {0};
     switch (gb.gameState) {
     case GameState::Normal:
-        sprintf(temp, "%.1f", currEval);
-        str = temp;
+        str = formatScore(currEval);
         break;
     case GameState::Checkmate:
         if (gb.board.state.xside == PieceColor::LIGHT)
@@ -202,11 +220,56 @@ void drawMoveList(const GUIBoard& gb, const Font& font) {
     DrawRectangleRounded(scrollSliderRect, 0.8, 5, BEIGE);
 }
 
-void update(GUIBoard& gb) {
+const float ANALYSIS_FONT_SIZE = 18;
+
+void drawAnalysisLines(const GUIBoard& gb, const Font& font, const std::vector<Search::Info>& lines) {
+    Rectangle rect = {moveListRect.x, moveListRect.y + moveListRect.height + 20, moveListRect.width,
+                      SCREEN_HEIGHT - (moveListRect.y + moveListRect.height + 20) - 30};
+    DrawRectangleRec(rect, DARKGRAY);
+
+    // The tables' verdict is exact, so it's shown next to the search's
+    Tablebase::WDL wdl;
+    int dtz;
+    if (Tablebase::probeDTZ(gb.board, wdl, dtz)) {
+        char text[48] = {0};
+        bool whiteToMove = gb.board.state.side == PieceColor::LIGHT;
+        if (wdl == Tablebase::WDL::Draw)
+            sprintf(text, "Tablebase: Draw");
+        else
+            sprintf(text, "Tablebase: %s wins, DTZ %d",
+                    (wdl == Tablebase::WDL::Win) == whiteToMove ? "White" : "Black", dtz);
+        DrawTextEx(font, text, {rect.x + 90, rect.y + 8}, ANALYSIS_FONT_SIZE, 0, BEIGE);
+    }
+    if (lines.empty())
+        return;
+
+    char header[32] = {0};
+    sprintf(header, "Depth %d", lines[0].depth);
+    DrawTextEx(font, header, {rect.x + 10, rect.y + 8}, ANALYSIS_FONT_SIZE, 0, {255, 255, 255, 190});
+
+    float y = rect.y + 12 + ANALYSIS_FONT_SIZE;
+    for (const Search::Info& info : lines) {
+        std::string text = formatScore(whiteScore(gb, info));
+        DrawTextEx(font, text.c_str(), {rect.x + 10, y}, ANALYSIS_FONT_SIZE, 0, BEIGE);
+        // Show as much of the PV as fits on one row
+        std::string pv;
+        for (int move : info.pv) {
+            std::string next = pv.empty() ? Move::toString(move) : pv + " " + Move::toString(move);
+            if (MeasureTextEx(font, next.c_str(), ANALYSIS_FONT_SIZE, 0).x > rect.width - 80)
+                break;
+            pv = next;
+        }
+        DrawTextEx(font, pv.c_str(), {rect.x + 70, y}, ANALYSIS_FONT_SIZE, 0, RAYWHITE);
+        y += ANALYSIS_FONT_SIZE + 6;
+    }
+}
+
+void update(GUIBoard& gb, Analysis& analysis) {
     gb.setSelection();
     gb.setMovePreviews();
     gb.setTarget();
-    gb.makeMove();
+    if (gb.makeMove())
+        analysis.start(gb.board);
     gb.updateGameState();
     isSlidingBarHeld(scrollSliderRect);
     if (isSliderHeld) {
@@ -216,7 +279,8 @@ void update(GUIBoard& gb) {
     }
 }
 
-void render(const GUIBoard& gb, const Texture& tex, const Font& evalFont, const Font& moveFont) {
+void render(const GUIBoard& gb, const Texture& tex, const Font& evalFont, const Font& moveFont,
+            const std::vector<Search::Info>& lines) {
     drawBoard(gb);
     for (int r = 0; r < 8; r++) {
         for (int f = 0; f < 8; f++) {
@@ -230,12 +294,13 @@ void render(const GUIBoard& gb, const Texture& tex, const Font& evalFont, const
         COLORLESS(gb.board.pos.getPieceOnSquare((int)gb.target)) == (int)PieceTypes::PAWN)
         drawPromotedChoices(gb, tex);
 
-    drawEvalBar(gb, evalFont);
+    drawEvalBar(gb, evalFont, lines);
     // drawCapturedPieces(gb, tex);
     drawMoveList(gb, moveFont);
+    drawAnalysisLines(gb, moveFont, lines);
 }
 
-int gui_main() {
+int gui_main(const std::string& enginePath) {
     SetConfigFlags(FLAG_MSAA_4X_HINT);
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "CEGUI");
 
@@ -257,15 +322,19 @@ int gui_main() {
     Font moveTextFont = LoadFontEx("assets/fonts/Inter-Medium.ttf", MOVE_TEXT_FONT_SIZE, 0, 0);
     SetTextureFilter(moveTextFont.texture, TEXTURE_FILTER_POINT);
 
+    Analysis analysis(enginePath);
+    analysis.start(gb.board);
+
     while (!WindowShouldClose()) {
-        update(gb);
+        update(gb, analysis);
         BeginDrawing();
         ClearBackground({24, 24, 24, 255});
 
-        render(gb, tex, evalFont, moveTextFont);
+        render(gb, tex, evalFont, moveTextFont, analysis.getLines());
 
         EndDrawing();
     }
+    analysis.stop();
 
     UnloadFont(evalFont);
     UnloadFont(moveTextFont);
@@ -4,47 +4,254 @@
 #include <string>
 
 #include "attack.hpp"
+#include "bench.hpp"
+#include "engine_manager.hpp"
 #include "gui_defs.hpp"
 
 
 #include "uci.hpp"
 #include "fen.hpp"
+#include "gamedb.hpp"
+#include "match.hpp"
 #include "board.hpp"
-void test() {
+#include "eval.hpp"
+#include "options.hpp"
+#include "pgn.hpp"
+#include "search.hpp"
+#include "tablebase.hpp"
+#include "tt.hpp"
+#include "tune.hpp"
+#include "zobrist.hpp"
+void test(const std::string& binaryPath) {
+    Eval::test();
     uciTest();
+    TT::test();
+    PGN::test();
+    GameDB::test();
+    // This binary stands in for an external engine
+    Engines::test(binaryPath);
 }
 
-enum class Mode { GUI, Terminal, Debug };
+enum class Mode {
+    GUI,
+    Terminal,
+    Search,
+    Bench,
+    EvalBench,
+    PGNBench,
+    Tune,
+    TablebaseGen,
+    PGNToDB,
+    DBToPGN,
+    Match,
+    TimeToDepth,
+    DepthAtTime,
+    Debug
+};
 
 Mode parseCmdArgs(int argc, char** argv) {
     Mode mode = Mode::Debug;
-    if (argc != 2) {
-        return mode;
+    // GUIs start engines without arguments and talk UCI to them
+    if (argc < 2) {
+        return Mode::Terminal;
     }
     std::string mode_str = argv[1];
     if (mode_str == "gui")
         mode = Mode::GUI;
     else if (mode_str == "term")
         mode = Mode::Terminal;
+    else if (mode_str == "search")
+        mode = Mode::Search;
+    else if (mode_str == "bench")
+        mode = Mode::Bench;
+    else if (mode_str == "evalbench")
+        mode = Mode::EvalBench;
+    else if (mode_str == "pgnbench")
+        mode = Mode::PGNBench;
+    else if (mode_str == "tune")
+        mode = Mode::Tune;
+    else if (mode_str == "tbgen")
+        mode = Mode::TablebaseGen;
+    else if (mode_str == "pgn2db")
+        mode = Mode::PGNToDB;
+    else if (mode_str == "db2pgn")
+        mode = Mode::DBToPGN;
+    else if (mode_str == "match")
+        mode = Mode::Match;
+    else if (mode_str == "ttd")
+        mode = Mode::TimeToDepth;
+    else if (mode_str == "dat")
+        mode = Mode::DepthAtTime;
     else if (mode_str == "debug")
         mode = Mode::Debug;
     return mode;
 }
 
-void init() { Attack::init(); }
+void init() {
+    Attack::init();
+    Zobrist::init();
+    Options::init();
+}
 
 int main(int argc, char** argv) {
     init();
     switch (parseCmdArgs(argc, argv)) {
     case Mode::GUI:
-        return gui_main();
+        // cegui gui [engine]
+        return gui_main(argc > 2 ? argv[2] : "");
         break;
     case Mode::Terminal:
-        std::cout << "*************** TODO: Terminal mode hasn't yet been implemented\n";
-        return 1;
+        uciLoop();
+        break;
+    case Mode::Search: {
+        Board board;
+        Search::Limits limits;
+        limits.depth = 5;
+        Search::search(board, limits);
+        break;
+    }
+    case Mode::Bench: {
+        // cegui bench [depth] [threads] [hash]
+        int depth = argc > 2 ? std::stoi(argv[2]) : 10;
+        int threads = argc > 3 ? std::stoi(argv[3]) : 1;
+        int hash = argc > 4 ? std::stoi(argv[4]) : 16;
+        Bench::run(depth, threads, hash);
+        break;
+    }
+    case Mode::EvalBench:
+        // cegui evalbench <network file>
+        if (argc < 3) {
+            std::cout << "Usage: cegui evalbench <network file>\n";
+            return 1;
+        }
+        Bench::evalSpeed(argv[2]);
+        break;
+    case Mode::PGNBench:
+        // cegui pgnbench <file.pgn>
+        if (argc < 3) {
+            std::cout << "Usage: cegui pgnbench <file.pgn>\n";
+            return 1;
+        }
+        Bench::pgnSpeed(argv[2]);
+        break;
+    case Mode::Tune: {
+        // cegui tune <file.epd|file.pgn>... [--epochs N] [--lr X] [--out header]
+        Tune::Settings settings;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--epochs" && i + 1 < argc)
+                settings.epochs = std::stoi(argv[++i]);
+            else if (arg == "--lr" && i + 1 < argc)
+                settings.learningRate = std::stod(argv[++i]);
+            else if (arg == "--out" && i + 1 < argc)
+                settings.output = argv[++i];
+            else
+                settings.files.push_back(arg);
+        }
+        if (settings.files.empty()) {
+            std::cout << "Usage: cegui tune <file.epd|file.pgn>... [--epochs N] [--lr X] "
+                         "[--out header]\n";
+            return 1;
+        }
+        Tune::run(settings);
+        break;
+    }
+    case Mode::TablebaseGen: {
+        // cegui tbgen <directory> [men]
+        if (argc < 3) {
+            std::cout << "Usage: cegui tbgen <directory> [men=4]\n";
+            return 1;
+        }
+        int men = argc > 3 ? std::stoi(argv[3]) : 4;
+        return Tablebase::generate(argv[2], men) ? 0 : 1;
+    }
+    case Mode::PGNToDB:
+        // cegui pgn2db <in.pgn> <out.cgdb>
+        if (argc < 4) {
+            std::cout << "Usage: cegui pgn2db <in.pgn> <out.cgdb>\n";
+            return 1;
+        }
+        return GameDB::fromPGN(argv[2], argv[3]) < 0 ? 1 : 0;
+    case Mode::DBToPGN:
+        // cegui db2pgn <in.cgdb> <out.pgn>
+        if (argc < 4) {
+            std::cout << "Usage: cegui db2pgn <in.cgdb> <out.pgn>\n";
+            return 1;
+        }
+        return GameDB::toPGN(argv[2], argv[3]) < 0 ? 1 : 0;
+    case Mode::Match: {
+        // cegui match <engine1> <engine2> [--games N] [--concurrency N] [--openings file]
+        //     [--tc base+inc | --movetime ms] [--maxmoves N] [--resign cp moves]
+        //     [--draw cp moves after] [--option name=value] [--pgn file]
+        //     [--sprt elo0 elo1] [--alpha A] [--beta B]
+        if (argc < 4) {
+            std::cout << "Usage: cegui match <engine1> <engine2> [--games N] [--concurrency N] "
+                         "[--openings file] [--tc base+inc | --movetime ms] [--maxmoves N] "
+                         "[--resign cp moves] [--draw cp moves after] [--option name=value] "
+                         "[--pgn file] [--sprt elo0 elo1] [--alpha A] [--beta B]\n";
+            return 1;
+        }
+        Match::Settings settings;
+        settings.engines = {argv[2], argv[3]};
+        bool gamesGiven = false;
+        for (int i = 4; i < argc; i++) {
+            std::string arg = argv[i];
+            auto next = [&] { return i + 1 < argc ? std::string(argv[++i]) : std::string("0"); };
+            if (arg == "--games") {
+                settings.games = std::stoi(next());
+                gamesGiven = true;
+            } else if (arg == "--sprt") {
+                settings.sprt = true;
+                settings.elo0 = std::stod(next());
+                settings.elo1 = std::stod(next());
+            } else if (arg == "--alpha")
+                settings.alpha = std::stod(next());
+            else if (arg == "--beta")
+                settings.beta = std::stod(next());
+            else if (arg == "--concurrency")
+                settings.concurrency = std::stoi(next());
+            else if (arg == "--openings")
+                settings.openings = next();
+            else if (arg == "--pgn")
+                settings.pgnOut = next();
+            else if (arg == "--movetime")
+                settings.movetime = std::stoll(next());
+            else if (arg == "--maxmoves")
+                settings.maxMoves = std::stoi(next());
+            else if (arg == "--tc") {
+                // Seconds, like '10+0.1'
+                std::string tc = next();
+                size_t plus = tc.find('+');
+                settings.baseTime = std::stod(tc.substr(0, plus)) * 1000;
+                settings.increment = plus == std::string::npos ? 0 : std::stod(tc.substr(plus + 1)) * 1000;
+            } else if (arg == "--resign") {
+                settings.resignScore = std::stoi(next());
+                settings.resignMoves = std::stoi(next());
+            } else if (arg == "--draw") {
+                settings.drawScore = std::stoi(next());
+                settings.drawMoves = std::stoi(next());
+                settings.drawAfter = std::stoi(next());
+            } else if (arg == "--option") {
+                std::string option = next();
+                size_t equals = option.find('=');
+                settings.options.push_back({option.substr(0, equals),
+                                            equals == std::string::npos ? "" : option.substr(equals + 1)});
+            }
+        }
+        // An SPRT runs until it decides unless it's given a limit
+        if (settings.sprt && !gamesGiven)
+            settings.games = 100000;
+        Match::run(settings);
+        break;
+    }
+    case Mode::TimeToDepth:
+        Bench::timeToDepth(6);
+        break;
+    case Mode::DepthAtTime:
+        Bench::depthAtTime(1000);
         break;
     case Mode::Debug:
-        test();
+        test(argv[0]);
         break;
     }
 }
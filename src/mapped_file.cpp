@@ -0,0 +1,71 @@
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <utility>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAS_MMAP
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+        buffer = std::move(other.buffer);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifdef HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void* mapped = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+    data = static_cast<const char*>(mapped);
+    size = st.st_size;
+    return true;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    buffer.resize(file.tellg());
+    file.seekg(0);
+    file.read(buffer.data(), buffer.size());
+    if (!file || buffer.empty()) {
+        buffer.clear();
+        return false;
+    }
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+#endif
+}
+
+void MappedFile::close() {
+#ifdef HAS_MMAP
+    if (data)
+        munmap(const_cast<char*>(data), size);
+#endif
+    buffer.clear();
+    buffer.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+}
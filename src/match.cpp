@@ -0,0 +1,499 @@
+#include "match.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#include "bitboard.hpp"
+#include "board.hpp"
+#include "engine_manager.hpp"
+#include "move.hpp"
+#include "pgn.hpp"
+#include "search.hpp"
+
+namespace Match {
+
+// Reading the reply through the pipes takes a moment, which isn't held against the engine
+constexpr long long TIME_MARGIN = 50;
+// How long a crashed or hung engine is waited for beyond its clock
+constexpr long long HANG_TIMEOUT = 5000;
+// Mate scores are treated as this many centipawns for adjudication
+constexpr int MATE_CP = 100000;
+
+double Results::score() const {
+    return games() ? (wins + draws / 2.0) / games() : 0.5;
+}
+
+double eloFromScore(const double score) {
+    double clamped = std::clamp(score, 1e-6, 1.0 - 1e-6);
+    return -400.0 * std::log10(1.0 / clamped - 1.0);
+}
+
+double Results::elo() const { return eloFromScore(score()); }
+
+double Results::eloError() const {
+    int n = games();
+    if (n == 0)
+        return 0.0;
+    double s = score();
+    double variance = (wins * (1.0 - s) * (1.0 - s) + draws * (0.5 - s) * (0.5 - s) +
+                       losses * s * s) /
+                      n;
+    // 1.96 standard deviations of the mean score, mapped through the Elo curve
+    double margin = 1.96 * std::sqrt(variance / n);
+    return (eloFromScore(s + margin) - eloFromScore(s - margin)) / 2.0;
+}
+
+double scoreFromElo(const double elo) { return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0)); }
+
+/* Generalized SPRT: the pair scores are treated as normally distributed around their sample
+   mean and variance, which makes the LLR a closed form in the two hypothesised scores. Pairs
+   rather than games are the samples, as both games of a pair share an opening and aren't
+   independent */
+double Results::llr(const double elo0, const double elo1) const {
+    int count = 0;
+    for (int n : pairs)
+        count += n;
+    if (count == 0)
+        return 0.0;
+    // Half a pair of prior weight in every outcome keeps the first few pairs from deciding the
+    // test on a variance close to 0, and washes out after a few hundred pairs
+    std::array<double, 5> weights;
+    double total = 0.0, mean = 0.0;
+    for (int i = 0; i < 5; i++) {
+        weights[i] = pairs[i] + 0.5;
+        total += weights[i];
+        mean += weights[i] * i / 4.0;
+    }
+    mean /= total;
+    double variance = 0.0;
+    for (int i = 0; i < 5; i++)
+        variance += weights[i] * (i / 4.0 - mean) * (i / 4.0 - mean);
+    variance /= total;
+    double s0 = scoreFromElo(elo0), s1 = scoreFromElo(elo1);
+    return count * (s1 - s0) * (2.0 * mean - s0 - s1) / (2.0 * variance);
+}
+
+double lowerBound(const Settings& settings) {
+    return std::log(settings.beta / (1.0 - settings.alpha));
+}
+
+double upperBound(const Settings& settings) {
+    return std::log((1.0 - settings.beta) / settings.alpha);
+}
+
+/* Opening positions, one per EPD line or the final position of each PGN game */
+bool loadOpenings(const std::string& path, std::vector<std::string>& fens) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "Failed to open '" << path << "'\n";
+        return false;
+    }
+    bool pgn = path.size() >= 4 && path.compare(path.size() - 4, 4, ".pgn") == 0;
+    std::string line;
+    if (!pgn) {
+        while (std::getline(file, line)) {
+            // Only the board, side, castling and en passant fields are used
+            std::istringstream ss(line);
+            std::string field, fen;
+            for (int i = 0; i < 4 && ss >> field; i++)
+                fen += (i ? " " : "") + field;
+            if (std::count(fen.begin(), fen.end(), ' ') == 3)
+                fens.push_back(fen + " 0 1");
+        }
+        return true;
+    }
+
+    // In file order, so a match plays the openings in the order they're listed
+    auto addOpening = [&](const PGNInfo& game, int) {
+        if (!game.valid)
+            return;
+        Board board(game.header.fen.empty() ? Board::position[1] : game.header.fen);
+        for (int move : game.moves)
+            Move::make(&board, move, Move::MoveType::allMoves);
+        fens.push_back(board.toFen());
+    };
+    return PGN::import(path, addOpening) >= 0;
+}
+
+/* Game state checks the engines aren't trusted with */
+
+// Neither side can mate: bare kings, or a single minor piece against a bare king
+bool insufficientMaterial(const Board& board) {
+    const auto& pieces = board.pos.pieces;
+    uint64_t heavy = pieces[(int)Piece::P] | pieces[(int)Piece::p] | pieces[(int)Piece::R] |
+                     pieces[(int)Piece::r] | pieces[(int)Piece::Q] | pieces[(int)Piece::q];
+    if (heavy)
+        return false;
+    uint64_t minors = pieces[(int)Piece::N] | pieces[(int)Piece::n] | pieces[(int)Piece::B] |
+                      pieces[(int)Piece::b];
+    return Bitboard::countBits(minors) <= 1;
+}
+
+int repetitions(const Board& board, const std::vector<uint64_t>& keys) {
+    int count = 0;
+    size_t reversible = std::min<size_t>(keys.size(), board.state.halfMoves);
+    for (size_t i = keys.size() - reversible; i < keys.size(); i++)
+        count += keys[i] == board.state.key;
+    return count;
+}
+
+/* One engine as seen by a worker. It's restarted if it crashed in an earlier game */
+struct Player
+{
+    std::string path;
+    Engines::Process* process = nullptr;
+    std::string name;
+
+    bool start(const Settings& settings) {
+        if (process && process->alive)
+            return true;
+        Engines::close(process);
+        process = Engines::spawn(path);
+        Engines::Event event;
+        if (!process || !process->send("uci"))
+            return false;
+        while (process->wait(event, 5000) && event.type != Engines::EventType::UciOk) {
+            std::string text = event.text.data();
+            if (event.type == Engines::EventType::Id && text.compare(0, 5, "name ") == 0)
+                name = text.substr(5);
+        }
+        if (event.type != Engines::EventType::UciOk)
+            return false;
+        if (name.empty())
+            name = path;
+        for (const auto& [option, value] : settings.options)
+            process->send("setoption name " + option + " value " + value);
+        return true;
+    }
+
+    bool newGame() {
+        Engines::Event event;
+        process->send("ucinewgame");
+        process->send("isready");
+        return process->waitFor(Engines::EventType::ReadyOk, event, 5000);
+    }
+
+    ~Player() { Engines::close(process); }
+};
+
+struct PlayedMove
+{
+    std::string san;
+    std::string comment;
+};
+
+struct Game
+{
+    int round = 0;
+    std::string fen;
+    std::array<std::string, 2> players; // [white, black]
+    std::vector<PlayedMove> moves;
+    std::string result = "*";
+    std::string termination;
+    // The result from the first engine's point of view
+    double firstScore = 0.5;
+};
+
+std::string formatComment(const Engines::Info& info, const bool hasScore,
+                          const long long elapsed) {
+    char text[48];
+    if (!hasScore)
+        snprintf(text, sizeof(text), "%.3fs", elapsed / 1000.0);
+    else if (info.mate)
+        snprintf(text, sizeof(text), "%sM%d/%d %.3fs", info.score > 0 ? "+" : "-",
+                 std::abs(info.score), info.depth, elapsed / 1000.0);
+    else
+        snprintf(text, sizeof(text), "%+.2f/%d %.3fs", info.score / 100.0, info.depth,
+                 elapsed / 1000.0);
+    return text;
+}
+
+/* Plays one game, 'players' are [white, black]. Ends the game with a loss for a side that
+   crashes, hangs, moves illegally or oversteps its clock */
+void play(Game& game, std::array<Player*, 2> players, const Settings& settings,
+          const std::atomic<bool>& aborted) {
+    Board board(game.fen);
+    std::vector<uint64_t> keys;
+    std::string positionCmd = "position fen " + game.fen + " moves";
+    std::array<long long, 2> clocks = {settings.baseTime, settings.baseTime};
+    std::array<int, 2> resignCounts = {0, 0};
+    int drawCount = 0;
+
+    auto finish = [&](const char* result, const std::string& termination) {
+        game.result = result;
+        game.termination = termination;
+    };
+    const char* whiteWins = "1-0";
+    const char* blackWins = "0-1";
+
+    for (int ply = 0;; ply++) {
+        if (aborted)
+            return finish("*", "Aborted");
+        int side = board.state.side == PieceColor::LIGHT ? 0 : 1;
+        const char* sideLoses = side == 0 ? blackWins : whiteWins;
+        if (!Move::hasLegalMove(board)) {
+            if (board.isOppInCheck())
+                finish(sideLoses, std::string(side == 0 ? "Black" : "White") + " mates");
+            else
+                finish("1/2-1/2", "Stalemate");
+            return;
+        }
+        if (board.state.halfMoves >= 100)
+            return finish("1/2-1/2", "Fifty move rule");
+        if (repetitions(board, keys) >= 2)
+            return finish("1/2-1/2", "Threefold repetition");
+        if (insufficientMaterial(board))
+            return finish("1/2-1/2", "Insufficient material");
+        if (settings.maxMoves > 0 && ply >= 2 * settings.maxMoves)
+            return finish("1/2-1/2", "Adjudication: move limit");
+
+        Player& player = *players[side];
+        std::string goCmd;
+        long long allowed;
+        if (settings.movetime > 0) {
+            goCmd = "go movetime " + std::to_string(settings.movetime);
+            allowed = settings.movetime;
+        } else {
+            goCmd = "go wtime " + std::to_string(clocks[0]) + " btime " +
+                    std::to_string(clocks[1]) + " winc " + std::to_string(settings.increment) +
+                    " binc " + std::to_string(settings.increment);
+            allowed = clocks[side];
+        }
+        player.process->send(positionCmd);
+        long long start = Search::now();
+        player.process->send(goCmd);
+
+        Engines::Event event;
+        Engines::Info lastInfo;
+        bool hasScore = false;
+        while (player.process->wait(event, std::max(0LL, start + allowed + HANG_TIMEOUT -
+                                                            Search::now()))) {
+            if (event.type == Engines::EventType::BestMove)
+                break;
+            if (event.type == Engines::EventType::Info && event.info.hasScore &&
+                event.info.multipv == 1) {
+                lastInfo = event.info;
+                hasScore = true;
+            }
+        }
+        long long elapsed = Search::now() - start;
+        if (event.type != Engines::EventType::BestMove) {
+            bool crashed = !player.process->alive;
+            // A hung engine can't be trusted with the next game
+            if (!crashed)
+                Engines::close(std::exchange(player.process, nullptr));
+            return finish(sideLoses, crashed ? player.name + " disconnects" : player.name + " hangs");
+        }
+        if (settings.movetime == 0) {
+            clocks[side] -= elapsed;
+            if (clocks[side] < -TIME_MARGIN)
+                return finish(sideLoses, player.name + " loses on time");
+            clocks[side] = std::max(0LL, clocks[side]) + settings.increment;
+        }
+
+        std::string moveText = event.bestMove.data();
+        int move = moveText.size() >= 4 ? Move::parse(moveText, board) : 0;
+        Board next = board;
+        if (!move || !Move::make(&next, move, Move::MoveType::allMoves))
+            return finish(sideLoses, player.name + " plays an illegal move " + moveText);
+        game.moves.push_back({Move::toSAN(move, board), formatComment(lastInfo, hasScore, elapsed)});
+        keys.push_back(board.state.key);
+        board = next;
+        positionCmd += " " + moveText;
+
+        // Score adjudication, trusting each engine's view of its own position
+        int score = !hasScore ? 0 : lastInfo.mate ? (lastInfo.score > 0 ? MATE_CP : -MATE_CP)
+                                                  : lastInfo.score;
+        resignCounts[side] = hasScore && score <= -settings.resignScore ? resignCounts[side] + 1 : 0;
+        if (settings.resignMoves > 0 && resignCounts[side] >= settings.resignMoves)
+            return finish(sideLoses, "Adjudication: " + player.name + " resigns");
+        drawCount = hasScore && std::abs(score) <= settings.drawScore ? drawCount + 1 : 0;
+        if (settings.drawMoves > 0 && ply / 2 + 1 >= settings.drawAfter &&
+            drawCount >= 2 * settings.drawMoves)
+            return finish("1/2-1/2", "Adjudication: draw score");
+    }
+}
+
+std::string today() {
+    char text[16];
+    std::time_t now = std::time(nullptr);
+    std::strftime(text, sizeof(text), "%Y.%m.%d", std::localtime(&now));
+    return text;
+}
+
+std::string timeControl(const Settings& settings) {
+    std::ostringstream ss;
+    if (settings.movetime > 0)
+        ss << settings.movetime / 1000.0 << "/move";
+    else
+        ss << settings.baseTime / 1000.0 << "+" << settings.increment / 1000.0;
+    return ss.str();
+}
+
+std::string toPGN(const Game& game, const Settings& settings) {
+    std::ostringstream ss;
+    ss << "[Event \"cegui match\"]\n";
+    ss << "[Site \"?\"]\n";
+    ss << "[Date \"" << today() << "\"]\n";
+    ss << "[Round \"" << game.round << "\"]\n";
+    ss << "[White \"" << game.players[0] << "\"]\n";
+    ss << "[Black \"" << game.players[1] << "\"]\n";
+    ss << "[Result \"" << game.result << "\"]\n";
+    ss << "[FEN \"" << game.fen << "\"]\n";
+    ss << "[SetUp \"1\"]\n";
+    ss << "[TimeControl \"" << timeControl(settings) << "\"]\n";
+    ss << "[PlyCount \"" << game.moves.size() << "\"]\n";
+    ss << "[Termination \"" << game.termination << "\"]\n\n";
+
+    std::vector<std::string> san, comments;
+    for (const PlayedMove& move : game.moves) {
+        san.push_back(move.san);
+        comments.push_back(move.comment);
+    }
+    PGN::writeMovetext(ss, Board(game.fen), san, comments, game.result, game.termination);
+    return ss.str();
+}
+
+/* Shared between the workers: the next game to start, the results and the PGN file */
+struct Tournament
+{
+    const Settings& settings;
+    const std::vector<std::string>& openings;
+    std::atomic<int> nextGame = 0;
+    // Set once the SPRT has decided, games still being played are abandoned
+    std::atomic<bool> finished = false;
+    std::mutex mutex;
+    std::ofstream pgn;
+    Results results;
+    // The first engine's score in the first game of each pair, until the second one ends
+    std::vector<double> pairScores;
+    long long startTime = Search::now();
+
+    Tournament(const Settings& settings, const std::vector<std::string>& openings)
+        : settings(settings), openings(openings), pgn(settings.pgnOut),
+          pairScores((settings.games + 1) / 2, -1.0) {}
+
+    void reportSPRT() {
+        double llr = results.llr(settings.elo0, settings.elo1);
+        double lower = lowerBound(settings), upper = upperBound(settings);
+        const auto& pairs = results.pairs;
+        printf("LLR %.2f (%.2f, %.2f) [%.1f, %.1f], pairs %d %d %d %d %d\n", llr, lower, upper,
+               settings.elo0, settings.elo1, pairs[0], pairs[1], pairs[2], pairs[3], pairs[4]);
+        if (llr <= lower || llr >= upper) {
+            printf("SPRT: %s accepted\n", llr >= upper ? "H1" : "H0");
+            finished = true;
+            nextGame = settings.games;
+        }
+    }
+
+    void report(const Game& game, const int index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (finished)
+            return;
+        pgn << toPGN(game, settings) << std::flush;
+        if (game.firstScore == 1.0)
+            results.wins++;
+        else if (game.firstScore == 0.0)
+            results.losses++;
+        else
+            results.draws++;
+
+        double hours = std::max(1LL, Search::now() - startTime) / 3600000.0;
+        printf("Game %d/%d: %s vs %s %s {%s}\n", game.round, settings.games,
+               game.players[0].c_str(), game.players[1].c_str(), game.result.c_str(),
+               game.termination.c_str());
+        printf("Score %d-%d-%d [%.3f] Elo %.1f +/- %.1f, %.0f games/h\n", results.wins,
+               results.losses, results.draws, results.score(), results.elo(),
+               results.eloError(), results.games() / hours);
+
+        // A pair counts once both of its games are done, whichever ends first
+        double& pairScore = pairScores[index / 2];
+        if (pairScore < 0.0) {
+            pairScore = game.firstScore;
+        } else {
+            results.pairs[(int)std::lround((pairScore + game.firstScore) * 2)]++;
+            if (settings.sprt)
+                reportSPRT();
+        }
+        fflush(stdout);
+    }
+
+    void work() {
+        std::array<Player, 2> engines;
+        engines[0].path = settings.engines[0];
+        engines[1].path = settings.engines[1];
+        for (int index; (index = nextGame++) < settings.games;) {
+            Game game;
+            game.round = index + 1;
+            // Both games of a pair share their opening, the first engine is white in the first
+            game.fen = openings[(index / 2) % openings.size()];
+            bool firstIsWhite = index % 2 == 0;
+            std::array<Player*, 2> players = {&engines[!firstIsWhite], &engines[firstIsWhite]};
+
+            bool ready = true;
+            for (Player* player : players)
+                ready = ready && player->start(settings) && player->newGame();
+            if (!ready) {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cout << "Failed to start the engines, stopping\n";
+                nextGame = settings.games;
+                return;
+            }
+            game.players = {players[0]->name, players[1]->name};
+            play(game, players, settings, finished);
+
+            double whiteScore = game.result == "1-0" ? 1.0 : game.result == "0-1" ? 0.0 : 0.5;
+            game.firstScore = firstIsWhite ? whiteScore : 1.0 - whiteScore;
+            report(game, index);
+        }
+    }
+};
+
+Results run(const Settings& settings) {
+    std::vector<std::string> openings;
+    if (!settings.openings.empty() && !loadOpenings(settings.openings, openings))
+        return {};
+    if (openings.empty())
+        openings.push_back(Board::position[1]);
+
+    int concurrency = settings.concurrency > 0
+                          ? settings.concurrency
+                          : std::max(1u, std::thread::hardware_concurrency());
+    concurrency = std::min(concurrency, settings.games);
+    std::cout << "Match: " << settings.engines[0] << " vs " << settings.engines[1] << ", "
+              << settings.games << " games, " << openings.size() << " openings, "
+              << timeControl(settings) << ", " << concurrency << " at a time\n";
+    if (settings.sprt)
+        printf("SPRT: elo0 %.1f, elo1 %.1f, alpha %.3f, beta %.3f\n", settings.elo0, settings.elo1,
+               settings.alpha, settings.beta);
+
+    Tournament tournament(settings, openings);
+    if (!tournament.pgn) {
+        std::cout << "Failed to open '" << settings.pgnOut << "'\n";
+        return {};
+    }
+    std::vector<std::thread> workers;
+    for (int i = 0; i < concurrency; i++)
+        workers.emplace_back([&] { tournament.work(); });
+    for (std::thread& worker : workers)
+        worker.join();
+    Engines::shutdown();
+
+    const Results& results = tournament.results;
+    printf("Finished %d games: %d-%d-%d, Elo %.1f +/- %.1f\n", results.games(), results.wins,
+           results.losses, results.draws, results.elo(), results.eloError());
+    if (settings.sprt)
+        printf("LLR %.2f (%.2f, %.2f)\n", results.llr(settings.elo0, settings.elo1),
+               lowerBound(settings), upperBound(settings));
+    return results;
+}
+
+} // namespace Match
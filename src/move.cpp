@@ -2,9 +2,14 @@
 
 #include "defs.hpp"
 
+#include <utility>
+
 #include "attack.hpp"
 #include "bitboard.hpp"
+#include "eval.hpp"
 #include "magics.hpp"
+#include "pgn.hpp"
+#include "zobrist.hpp"
 
 namespace Move
 {
@@ -16,6 +21,19 @@ void MoveList::add(const int move) {
     count++;
 }
 
+/* Partial selection sort: swaps the best scored move among the remaining ones into 'index' and
+   returns it. A cutoff usually comes early, so sorting the whole list would be wasted work */
+int MoveList::pickNext(const int index) {
+    int best = index;
+    for (int i = index + 1; i < count; i++) {
+        if (scores[i] > scores[best])
+            best = i;
+    }
+    std::swap(list[index], list[best]);
+    std::swap(scores[index], scores[best]);
+    return list[index];
+}
+
 // Returns index from move list, if move is found
 int MoveList::search(const int source, const int target, const int promoted) const {
     for (int i = 0; i < count; i++) {
@@ -94,6 +112,117 @@ int parse(const std::string &moveStr, const Board &board) {
     return searchedMove;
 }
 
+/* Resolves a move in standard algebraic notation (e.g. "Nbd7", "exd8=Q+", "O-O"). Returns 0
+   if no legal move matches */
+int parseSAN(std::string_view san, const Board &board) {
+    MoveInfo info;
+    return info.parse(san) ? info.resolve(board) : 0;
+}
+
+/* Whether a pseudo-legal move keeps the mover's king safe, without making it. The attacks on
+   the king are looked up with the occupancy after the move, which covers pins, discovered
+   checks and evasions alike */
+bool isLegal(const Board &board, const int move) {
+    bool white = board.state.side == PieceColor::LIGHT;
+    int us = (int)board.state.side, them = white ? 6 : 0;
+    int source = getSource(move), target = getTarget(move);
+    int king = white ? (int)Piece::K : (int)Piece::k;
+    int kingSq = getPiece(move) == king ? target : Bitboard::lsbIndex(board.pos.pieces[king]);
+
+    uint64_t occupancy = board.pos.units[(int)PieceColor::BOTH];
+    uint64_t removed = 1ULL << target;
+    if (isEnpassant(move))
+        removed |= 1ULL << (white ? target + 8 : target - 8);
+    occupancy = (occupancy & ~(1ULL << source) & ~removed) | (1ULL << target);
+    // The castled rook may shield the king's new square along the back rank
+    if (isCastling(move)) {
+        bool kingside = COL(target) == 6;
+        occupancy ^= (1ULL << (kingside ? target + 1 : target - 2)) | (1ULL << (kingside ? target - 1 : target + 1));
+    }
+    // A captured piece doesn't attack anymore
+    auto enemy = [&](Piece piece) { return board.pos.pieces[(int)piece + them] & ~removed; };
+
+    if (Attack::pawnAttacks[us][kingSq] & enemy(Piece::P))
+        return false;
+    if (Attack::knightAttacks[kingSq] & enemy(Piece::N))
+        return false;
+    if (Attack::kingAttacks[kingSq] & enemy(Piece::K))
+        return false;
+    if (Magics::getBishopAttack(kingSq, occupancy) & (enemy(Piece::B) | enemy(Piece::Q)))
+        return false;
+    if (Magics::getRookAttack(kingSq, occupancy) & (enemy(Piece::R) | enemy(Piece::Q)))
+        return false;
+    return true;
+}
+
+// Whether the side to move has any legal move, stopping at the first one found
+bool hasLegalMove(const Board &board) {
+    MoveList moveList;
+    generate(moveList, board);
+    for (int i = 0; i < moveList.count; i++) {
+        if (isLegal(board, moveList.list[i]))
+            return true;
+    }
+    return false;
+}
+
+/* Writes a legal move in standard algebraic notation, with just enough disambiguation and a
+   check or mate mark. Rival pieces are found by looking back from the target square, as in
+   MoveInfo::resolve */
+std::string toSAN(const int move, const Board &board) {
+    int piece = getPiece(move), source = getSource(move), target = getTarget(move);
+    int type = piece % 6;
+    std::string san;
+    if (isCastling(move)) {
+        san = COL(target) == 6 ? "O-O" : "O-O-O";
+    } else if (type == (int)PieceTypes::PAWN) {
+        if (isCapture(move)) {
+            san += strCoords[source][0];
+            san += 'x';
+        }
+        san += strCoords[target];
+        if (getPromoted(move) != (int)Piece::E) {
+            san += '=';
+            san += pieceStr[getPromoted(move) % 6];
+        }
+    } else {
+        san += pieceStr[type];
+        uint64_t occupancy = board.pos.units[(int)PieceColor::BOTH];
+        uint64_t rivals = board.pos.pieces[piece] & ~(1ULL << source);
+        switch ((PieceTypes)type) {
+        case PieceTypes::KNIGHT: rivals &= Attack::knightAttacks[target]; break;
+        case PieceTypes::BISHOP: rivals &= Magics::getBishopAttack(target, occupancy); break;
+        case PieceTypes::ROOK: rivals &= Magics::getRookAttack(target, occupancy); break;
+        case PieceTypes::QUEEN: rivals &= Magics::getQueenAttack(target, occupancy); break;
+        default: rivals = 0; break;
+        }
+        bool ambiguous = false, sameFile = false, sameRank = false;
+        while (rivals) {
+            int other = Bitboard::lsbIndex(rivals);
+            rivals &= rivals - 1;
+            // A pinned rival can't go there, so it doesn't need telling apart
+            if (!isLegal(board, encode(other, target, piece, (int)Piece::E, isCapture(move), 0, 0, 0)))
+                continue;
+            ambiguous = true;
+            sameFile |= COL(other) == COL(source);
+            sameRank |= ROW(other) == ROW(source);
+        }
+        if (ambiguous && (!sameFile || sameRank))
+            san += strCoords[source][0];
+        if (sameFile)
+            san += strCoords[source][1];
+        if (isCapture(move))
+            san += 'x';
+        san += strCoords[target];
+    }
+
+    Board next = board;
+    make(&next, move, MoveType::allMoves);
+    if (next.isOppInCheck())
+        san += hasLegalMove(next) ? '+' : '#';
+    return san;
+}
+
 void generate(MoveList &moveList, const Board &board) {
     generatePawns(moveList, board);
     generateKnights(moveList, board);
@@ -103,6 +232,74 @@ void generate(MoveList &moveList, const Board &board) {
     generateKings(moveList, board);
 }
 
+/* Generates only capturing moves (including enpassant and capture promotions) for the
+   quiescence search, without walking any quiet targets */
+void generateCaptures(MoveList &moveList, const Board &board) {
+    bool isWhite = board.state.side == PieceColor::LIGHT;
+    uint64_t enemies = board.pos.units[(int)board.state.xside];
+    uint64_t occupancy = board.pos.units[(int)PieceColor::BOTH];
+    int source, target;
+
+    // Pawn captures
+    int piece = isWhite ? (int)Piece::P : (int)Piece::p;
+    int promotionStart = isWhite ? (int)Sq::a7 : (int)Sq::a2;
+    uint64_t bitboard = board.pos.pieces[piece], attack;
+    while (bitboard) {
+        source = Bitboard::lsbIndex(bitboard);
+        attack = Attack::pawnAttacks[(int)board.state.side][source] & enemies;
+        while (attack) {
+            target = Bitboard::lsbIndex(attack);
+            if (source >= promotionStart && source <= promotionStart + 7) {
+                for (int promoted = (int)PieceTypes::QUEEN; promoted >= (int)PieceTypes::KNIGHT;
+                     promoted--)
+                    moveList.add(
+                        encode(source, target, piece, isWhite ? promoted : promoted + 6, 1, 0, 0, 0));
+            } else {
+                moveList.add(encode(source, target, piece, (int)Piece::E, 1, 0, 0, 0));
+            }
+            popBit(attack, target);
+        }
+        if (board.state.enpassant != Sq::noSq &&
+            getBit(Attack::pawnAttacks[(int)board.state.side][source], (int)board.state.enpassant))
+            moveList.add(
+                encode(source, (int)board.state.enpassant, piece, (int)Piece::E, 1, 0, 1, 0));
+        popBit(bitboard, source);
+    }
+
+    // Piece captures
+    for (int type = (int)PieceTypes::KNIGHT; type <= (int)PieceTypes::KING; type++) {
+        piece = isWhite ? type : type + 6;
+        bitboard = board.pos.pieces[piece];
+        while (bitboard) {
+            source = Bitboard::lsbIndex(bitboard);
+            switch ((PieceTypes)type) {
+            case PieceTypes::KNIGHT:
+                attack = Attack::knightAttacks[source];
+                break;
+            case PieceTypes::BISHOP:
+                attack = Magics::getBishopAttack(source, occupancy);
+                break;
+            case PieceTypes::ROOK:
+                attack = Magics::getRookAttack(source, occupancy);
+                break;
+            case PieceTypes::QUEEN:
+                attack = Magics::getQueenAttack(source, occupancy);
+                break;
+            default:
+                attack = Attack::kingAttacks[source];
+                break;
+            }
+            attack &= enemies;
+            while (attack) {
+                target = Bitboard::lsbIndex(attack);
+                moveList.add(encode(source, target, piece, (int)Piece::E, 1, 0, 0, 0));
+                popBit(attack, target);
+            }
+            popBit(bitboard, source);
+        }
+    }
+}
+
 void generatePawns(MoveList &moveList, const Board &board) {
     uint64_t bitboardCopy, attackCopy;
     int promotionStart, direction, doublePushStart, piece;
@@ -391,10 +588,20 @@ bool make(Board *main, const int move, MoveType moveFlag) {
         bool enpassant = isEnpassant(move);
         bool castling = isCastling(move);
 
+        uint64_t& key = main->state.key;
+
         // Remove piece from 'source' and place on 'target'
         popBit(main->pos.pieces[piece], source);
 
         setBit(main->pos.pieces[piece], target);
+        key ^= Zobrist::pieceKeys[piece][source] ^ Zobrist::pieceKeys[piece][target];
+        Eval::movePiece(*main, piece, source, target);
+
+        // Pawn moves and captures reset the fifty move counter
+        if (capture || COLORLESS(piece) == (int)PieceTypes::PAWN)
+            main->state.halfMoves = 0;
+        else
+            main->state.halfMoves++;
 
         // If capture, remove piece of opponent bitboard
         if (capture) {
@@ -403,6 +610,8 @@ bool make(Board *main, const int move, MoveType moveFlag) {
                  bbPiece++) {
                 if (getBit(main->pos.pieces[bbPiece], target)) {
                     popBit(main->pos.pieces[bbPiece], target);
+                    key ^= Zobrist::pieceKeys[bbPiece][target];
+                    Eval::removePiece(*main, bbPiece, target);
                     break;
                 }
             }
@@ -413,6 +622,9 @@ bool make(Board *main, const int move, MoveType moveFlag) {
             popBit(main->pos.pieces[piece], target);
 
             setBit(main->pos.pieces[promoted], target);
+            key ^= Zobrist::pieceKeys[piece][target] ^ Zobrist::pieceKeys[promoted][target];
+            Eval::removePiece(*main, piece, target);
+            Eval::addPiece(*main, promoted, target);
         }
 
         // Enpassant capture
@@ -420,12 +632,17 @@ bool make(Board *main, const int move, MoveType moveFlag) {
             // If white to move
             if (main->state.side == PieceColor::LIGHT) {
                 popBit(main->pos.pieces[(int)Piece::p], target + (int)Direction::NORTH);
+                key ^= Zobrist::pieceKeys[(int)Piece::p][target + (int)Direction::NORTH];
+                Eval::removePiece(*main, (int)Piece::p, target + (int)Direction::NORTH);
             } else {
                 popBit(main->pos.pieces[(int)Piece::P], target + (int)Direction::SOUTH);
+                key ^= Zobrist::pieceKeys[(int)Piece::P][target + (int)Direction::SOUTH];
+                Eval::removePiece(*main, (int)Piece::P, target + (int)Direction::SOUTH);
             }
         }
         if (main->state.enpassant != Sq::noSq) {
             // Reset enpassant, regardless of an enpassant capture
+            key ^= Zobrist::enpassantKeys[(int)main->state.enpassant];
             main->state.enpassant = Sq::noSq;
         }
 
@@ -435,6 +652,7 @@ bool make(Board *main, const int move, MoveType moveFlag) {
                 main->state.enpassant = (Sq)(target + (int)Direction::NORTH);
             else
                 main->state.enpassant = (Sq)(target + (int)Direction::SOUTH);
+            key ^= Zobrist::enpassantKeys[(int)main->state.enpassant];
         }
 
         // Castling
@@ -444,34 +662,49 @@ bool make(Board *main, const int move, MoveType moveFlag) {
                 popBit(main->pos.pieces[(int)Piece::R], (int)Sq::h1);
 
                 setBit(main->pos.pieces[(int)Piece::R], (int)Sq::f1);
+                key ^= Zobrist::pieceKeys[(int)Piece::R][(int)Sq::h1] ^
+                       Zobrist::pieceKeys[(int)Piece::R][(int)Sq::f1];
+                Eval::movePiece(*main, (int)Piece::R, (int)Sq::h1, (int)Sq::f1);
                 break;
             case (int)Sq::c1:
                 popBit(main->pos.pieces[(int)Piece::R], (int)Sq::a1);
 
                 setBit(main->pos.pieces[(int)Piece::R], (int)Sq::d1);
+                key ^= Zobrist::pieceKeys[(int)Piece::R][(int)Sq::a1] ^
+                       Zobrist::pieceKeys[(int)Piece::R][(int)Sq::d1];
+                Eval::movePiece(*main, (int)Piece::R, (int)Sq::a1, (int)Sq::d1);
                 break;
             case (int)Sq::g8:
                 popBit(main->pos.pieces[(int)Piece::r], (int)Sq::h8);
 
                 setBit(main->pos.pieces[(int)Piece::r], (int)Sq::f8);
+                key ^= Zobrist::pieceKeys[(int)Piece::r][(int)Sq::h8] ^
+                       Zobrist::pieceKeys[(int)Piece::r][(int)Sq::f8];
+                Eval::movePiece(*main, (int)Piece::r, (int)Sq::h8, (int)Sq::f8);
                 break;
             case (int)Sq::c8:
                 popBit(main->pos.pieces[(int)Piece::r], (int)Sq::a8);
 
                 setBit(main->pos.pieces[(int)Piece::r], (int)Sq::d8);
+                key ^= Zobrist::pieceKeys[(int)Piece::r][(int)Sq::a8] ^
+                       Zobrist::pieceKeys[(int)Piece::r][(int)Sq::d8];
+                Eval::movePiece(*main, (int)Piece::r, (int)Sq::a8, (int)Sq::d8);
                 break;
             }
         }
 
         // Update castling rights
+        key ^= Zobrist::castlingKeys[main->state.castling];
         main->state.castling &= castlingRights[source];
         main->state.castling &= castlingRights[target];
+        key ^= Zobrist::castlingKeys[main->state.castling];
 
         // Update units (or occupancies)
         main->pos.updateUnits();
 
         // Change side
         main->state.changeSide();
+        key ^= Zobrist::sideKey;
 
         // Check if king is in check
         if (main->isInCheck()) {
@@ -492,4 +725,15 @@ bool make(Board *main, const int move, MoveType moveFlag) {
     }
 }
 
+/* Passes the turn without moving a piece, used by null move pruning */
+void makeNull(Board *main) {
+    if (main->state.enpassant != Sq::noSq) {
+        main->state.key ^= Zobrist::enpassantKeys[(int)main->state.enpassant];
+        main->state.enpassant = Sq::noSq;
+    }
+    main->state.halfMoves++;
+    main->state.changeSide();
+    main->state.key ^= Zobrist::sideKey;
+}
+
 } // namespace Move
@@ -0,0 +1,229 @@
+#include "nnue.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "bitboard.hpp"
+#include "board.hpp"
+#include "mapped_file.hpp"
+
+namespace NNUE {
+
+Network network;
+bool loaded = false;
+
+/* File layout, little endian: the header, then the feature weights, feature biases and output
+   weights as int16 and the output bias as int32 */
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t inputs;
+    uint32_t hidden;
+};
+
+constexpr char MAGIC[4] = {'C', 'G', 'N', 'N'};
+constexpr uint32_t VERSION = 1;
+constexpr size_t FILE_SIZE = sizeof(Header) +
+                             sizeof(int16_t) * (INPUTS * HIDDEN + HIDDEN + 2 * HIDDEN) +
+                             sizeof(int32_t);
+
+MappedFile file;
+
+/* Loads a network, on failure the previous one is kept */
+bool load(const std::string& path) {
+    MappedFile newFile;
+    if (!newFile.open(path)) {
+        std::cerr << "Failed to open network file '" << path << "'\n";
+        return false;
+    }
+    Header header;
+    std::memcpy(&header, newFile.data, std::min(newFile.size, sizeof(Header)));
+    if (newFile.size != FILE_SIZE || std::memcmp(header.magic, MAGIC, 4) != 0 ||
+        header.version != VERSION || header.inputs != INPUTS || header.hidden != HIDDEN) {
+        std::cerr << "'" << path << "' isn't a compatible network file\n";
+        return false;
+    }
+
+    file = std::move(newFile);
+    const char* p = file.data + sizeof(Header);
+    network.featureWeights = reinterpret_cast<const int16_t*>(p);
+    p += sizeof(int16_t) * INPUTS * HIDDEN;
+    network.featureBias = reinterpret_cast<const int16_t*>(p);
+    p += sizeof(int16_t) * HIDDEN;
+    network.outputWeights = reinterpret_cast<const int16_t*>(p);
+    p += sizeof(int16_t) * 2 * HIDDEN;
+    std::memcpy(&network.outputBias, p, sizeof(int32_t));
+    loaded = true;
+    return true;
+}
+
+void unload() {
+    file.close();
+    network = Network();
+    loaded = false;
+}
+
+/* Feature of a piece on a square as seen by 'perspective': black sees the board flipped and
+   its own pieces as the first six */
+inline int featureIndex(const int perspective, const int piece, const int sq) {
+    if (perspective == (int)PieceColor::LIGHT)
+        return piece * 64 + sq;
+    return ((piece + 6) % 12) * 64 + FLIP(sq);
+}
+
+/* Accumulator kernels. The weights live in the mapped file and are only 2 byte aligned, so
+   they're loaded unaligned while the accumulator is aligned */
+inline void addColumn(int16_t* acc, const int16_t* column) {
+#if defined(__AVX2__)
+    for (int i = 0; i < HIDDEN; i += 16) {
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc + i));
+        __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_add_epi16(a, w));
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < HIDDEN; i += 8) {
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + i));
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column + i));
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc + i), _mm_add_epi16(a, w));
+    }
+#else
+    for (int i = 0; i < HIDDEN; i++)
+        acc[i] += column[i];
+#endif
+}
+
+inline void subColumn(int16_t* acc, const int16_t* column) {
+#if defined(__AVX2__)
+    for (int i = 0; i < HIDDEN; i += 16) {
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc + i));
+        __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_sub_epi16(a, w));
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < HIDDEN; i += 8) {
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + i));
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column + i));
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc + i), _mm_sub_epi16(a, w));
+    }
+#else
+    for (int i = 0; i < HIDDEN; i++)
+        acc[i] -= column[i];
+#endif
+}
+
+// Fused add and subtract, so a quiet move touches the accumulator once
+inline void addSubColumns(int16_t* acc, const int16_t* added, const int16_t* removed) {
+#if defined(__AVX2__)
+    for (int i = 0; i < HIDDEN; i += 16) {
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc + i));
+        __m256i add = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(added + i));
+        __m256i sub = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(removed + i));
+        a = _mm256_sub_epi16(_mm256_add_epi16(a, add), sub);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc + i), a);
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < HIDDEN; i += 8) {
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + i));
+        __m128i add = _mm_loadu_si128(reinterpret_cast<const __m128i*>(added + i));
+        __m128i sub = _mm_loadu_si128(reinterpret_cast<const __m128i*>(removed + i));
+        a = _mm_sub_epi16(_mm_add_epi16(a, add), sub);
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc + i), a);
+    }
+#else
+    for (int i = 0; i < HIDDEN; i++)
+        acc[i] += added[i] - removed[i];
+#endif
+}
+
+/* Output layer: the dot product of the clipped accumulator with the output weights */
+inline int32_t dotClipped(const int16_t* acc, const int16_t* weights) {
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa = _mm256_set1_epi16(QA);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < HIDDEN; i += 16) {
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc + i));
+        __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+        a = _mm256_min_epi16(_mm256_max_epi16(a, zero), qa);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a, w));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+    return _mm_cvtsi128_si32(half);
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i qa = _mm_set1_epi16(QA);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < HIDDEN; i += 8) {
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + i));
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i));
+        a = _mm_min_epi16(_mm_max_epi16(a, zero), qa);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a, w));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < HIDDEN; i++)
+        sum += std::clamp<int32_t>(acc[i], 0, QA) * weights[i];
+    return sum;
+#endif
+}
+
+inline const int16_t* column(const int feature) {
+    return network.featureWeights + feature * HIDDEN;
+}
+
+/* Rebuilds both accumulators from the pieces on the board */
+void refresh(Accumulator& accumulator, const Board& board) {
+    for (int perspective = 0; perspective < 2; perspective++) {
+        std::memcpy(accumulator.values[perspective].data(), network.featureBias,
+                    sizeof(int16_t) * HIDDEN);
+        for (int piece = (int)Piece::P; piece <= (int)Piece::k; piece++) {
+            uint64_t bitboard = board.pos.pieces[piece];
+            while (bitboard) {
+                int sq = Bitboard::lsbIndex(bitboard);
+                addColumn(accumulator.values[perspective].data(),
+                          column(featureIndex(perspective, piece, sq)));
+                popBit(bitboard, sq);
+            }
+        }
+    }
+}
+
+void addPiece(Accumulator& accumulator, const int piece, const int sq) {
+    for (int perspective = 0; perspective < 2; perspective++)
+        addColumn(accumulator.values[perspective].data(),
+                  column(featureIndex(perspective, piece, sq)));
+}
+
+void removePiece(Accumulator& accumulator, const int piece, const int sq) {
+    for (int perspective = 0; perspective < 2; perspective++)
+        subColumn(accumulator.values[perspective].data(),
+                  column(featureIndex(perspective, piece, sq)));
+}
+
+void movePiece(Accumulator& accumulator, const int piece, const int source, const int target) {
+    for (int perspective = 0; perspective < 2; perspective++)
+        addSubColumns(accumulator.values[perspective].data(),
+                      column(featureIndex(perspective, piece, target)),
+                      column(featureIndex(perspective, piece, source)));
+}
+
+/* Returns the evaluation in centipawns from the side to move's point of view */
+int evaluate(const Accumulator& accumulator, const PieceColor side) {
+    int us = (int)side, them = us ^ 1;
+    int32_t output = dotClipped(accumulator.values[us].data(), network.outputWeights) +
+                     dotClipped(accumulator.values[them].data(), network.outputWeights + HIDDEN);
+    return (int)((int64_t)(output + network.outputBias) * SCALE / (QA * QB));
+}
+
+} // namespace NNUE
@@ -0,0 +1,131 @@
+#include "options.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include "nnue.hpp"
+#include "tablebase.hpp"
+#include "tt.hpp"
+
+namespace Options {
+
+std::vector<Option> options;
+
+void add(const std::string& name, OptionType type, int defaultValue, int min, int max,
+         void (*onChange)(int value) = nullptr) {
+    options.push_back({name, type, defaultValue, min, max, defaultValue, onChange, "", "", nullptr});
+}
+
+void addText(const std::string& name, const std::string& defaultText,
+             void (*onTextChange)(const std::string& text) = nullptr) {
+    options.push_back(
+        {name, OptionType::String, 0, 0, 0, 0, nullptr, defaultText, defaultText, onTextChange});
+}
+
+/* Registers every engine option with its default value and applies the defaults */
+void init() {
+    add("Hash", OptionType::Spin, 16, 1, 65536, [](int value) { TT::resize(value); });
+    add("Threads", OptionType::Spin, 1, 1, 256);
+    add("MultiPV", OptionType::Spin, 1, 1, 256);
+    // Only tells the engine that the GUI may send 'go ponder', the search doesn't depend on it
+    add("Ponder", OptionType::Check, 0, 0, 1);
+    // Time reserved per move for communication delays, in ms
+    add("MoveOverhead", OptionType::Spin, 30, 0, 5000);
+    // Selective search switches
+    add("NullMove", OptionType::Check, 1, 0, 1);
+    add("LMR", OptionType::Check, 1, 0, 1);
+    add("Futility", OptionType::Check, 1, 0, 1);
+    add("CheckExtensions", OptionType::Check, 1, 0, 1);
+    // Network file, the handcrafted evaluation is used while it's empty
+    addText("EvalFile", "", [](const std::string& text) {
+        if (text.empty())
+            NNUE::unload();
+        else
+            NNUE::load(text);
+    });
+    /* Directory of endgame tablebase files, none are probed while it's empty or missing. Tables
+       generated with 'cegui tbgen tablebases' are picked up from the working directory */
+    addText("TablebasePath", "tablebases", [](const std::string& text) { Tablebase::init(text); });
+
+    for (Option& option : options) {
+        if (option.onChange)
+            option.onChange(option.value);
+        if (option.onTextChange && !option.text.empty())
+            option.onTextChange(option.text);
+    }
+}
+
+// Option names are case insensitive
+bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                      [](char x, char y) { return std::tolower(x) == std::tolower(y); });
+}
+
+Option* find(const std::string& name) {
+    for (Option& option : options) {
+        if (equalsIgnoreCase(option.name, name))
+            return &option;
+    }
+    return nullptr;
+}
+
+/* Sets an option from its string value, returns false if the option doesn't exist */
+bool set(const std::string& name, const std::string& value) {
+    Option* option = find(name);
+    if (!option)
+        return false;
+
+    if (option->type == OptionType::String) {
+        // UCI GUIs send '<empty>' to clear a string option
+        std::string newText = value == "<empty>" ? "" : value;
+        if (newText == option->text)
+            return true;
+        option->text = newText;
+        if (option->onTextChange)
+            option->onTextChange(newText);
+        return true;
+    }
+
+    int newValue;
+    if (option->type == OptionType::Check)
+        newValue = equalsIgnoreCase(value, "true");
+    else
+        newValue = std::clamp(std::atoi(value.c_str()), option->min, option->max);
+
+    if (newValue == option->value)
+        return true;
+    option->value = newValue;
+    if (option->onChange)
+        option->onChange(newValue);
+    return true;
+}
+
+int get(const std::string& name) {
+    Option* option = find(name);
+    return option ? option->value : 0;
+}
+
+std::string getText(const std::string& name) {
+    Option* option = find(name);
+    return option ? option->text : "";
+}
+
+/* Prints every option the way the UCI 'uci' command expects */
+void print() {
+    for (const Option& option : options) {
+        std::cout << "option name " << option.name;
+        if (option.type == OptionType::Check)
+            std::cout << " type check default " << (option.defaultValue ? "true" : "false");
+        else if (option.type == OptionType::String)
+            std::cout << " type string default "
+                      << (option.defaultText.empty() ? "<empty>" : option.defaultText);
+        else
+            std::cout << " type spin default " << option.defaultValue << " min " << option.min
+                      << " max " << option.max;
+        std::cout << "\n";
+    }
+    std::cout.flush();
+}
+
+} // namespace Options
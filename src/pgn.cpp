@@ -1,32 +1,329 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <regex>
+#include <sstream>
+#include <mutex>
 #include <string>
+#include <thread>
 
+#include "attack.hpp"
+#include "bitboard.hpp"
 #include "board.hpp"
+#include "magics.hpp"
+#include "move.hpp"
+#include "parallel.hpp"
 #include "pgn.hpp"
 
 // PGN File format specification
 // Source: http://www.saremba.de/chessgml/standards/pgn/pgn-complete.htm
 
-const std::string HEADER_PATTERN = "\\[(\\w+) \"([\\w., -\\/?:]+)\"\\]";
-const std::string MOVE_PATTERN =
-    "([NBRQK])?([a-h]|[1-8])?(x)?([a-h][1-8])(=)?([NBRQ])?([+#])?|(O-O|O-O-O)";
-
-PGNHeader::PGNHeader(const std::string& headerStr) {
-    std::regex rgx(HEADER_PATTERN);
-    std::smatch match;
-    std::string header = headerStr;
-    while (std::regex_search(header, match, rgx)) {
-        // [ <  KEY   > "<  VALUE >"]
-        // [ <match[1]> "<match[2]>"]
-        std::string key = match[1];
-        std::string value = match[2];
-
-        if (value == "?") {
-            header = match.suffix();
+namespace PGN {
+
+std::string_view Game::tag(std::string_view name) const {
+    for (const Tag& tag : tags) {
+        if (tag.name == name)
+            return tag.value;
+    }
+    return {};
+}
+
+bool Reader::open(const std::string& path) {
+    if (!file.open(path))
+        return false;
+    text = std::string_view(file.data, file.size);
+    pos = 0;
+    return true;
+}
+
+void Reader::skipLine() {
+    const char* newline =
+        static_cast<const char*>(std::memchr(text.data() + pos, '\n', text.size() - pos));
+    pos = newline ? newline - text.data() + 1 : text.size();
+}
+
+/* '[Name "value"]', returns false and skips the line if it's malformed */
+bool Reader::readTag(Tag& tag) {
+    size_t i = pos + 1;
+    while (i < text.size() && text[i] == ' ')
+        i++;
+    size_t nameBegin = i;
+    while (i < text.size() && text[i] != ' ' && text[i] != '"' && text[i] != ']' && text[i] != '\n')
+        i++;
+    tag.name = text.substr(nameBegin, i - nameBegin);
+    while (i < text.size() && text[i] == ' ')
+        i++;
+    if (i >= text.size() || text[i] != '"') {
+        skipLine();
+        return false;
+    }
+    size_t valueBegin = ++i;
+    while (i < text.size() && text[i] != '"' && text[i] != '\n')
+        i += text[i] == '\\' ? 2 : 1;
+    if (i >= text.size() || text[i] != '"') {
+        skipLine();
+        return false;
+    }
+    tag.value = text.substr(valueBegin, i - valueBegin);
+    pos = i + 1;
+    skipLine();
+    return !tag.name.empty();
+}
+
+/* Movetext runs up to the next line that starts with a tag. Comments may contain anything,
+   so they're stepped over whole. Lines are searched with memchr rather than byte by byte, as
+   this scan sees every byte of the file */
+void Reader::readMovetext(Game& game) {
+    const char* data = text.data();
+    size_t begin = pos, end = text.size();
+    while (pos < text.size()) {
+        const char* newline = static_cast<const char*>(std::memchr(data + pos, '\n', text.size() - pos));
+        size_t lineEnd = newline ? newline - data : text.size();
+        const char* brace = static_cast<const char*>(std::memchr(data + pos, '{', lineEnd - pos));
+        // A brace after a semicolon is part of a comment that ends with the line
+        const char* semicolon = static_cast<const char*>(
+            std::memchr(data + pos, ';', (brace ? brace - data : lineEnd) - pos));
+        if (brace && !semicolon) {
+            const char* close =
+                static_cast<const char*>(std::memchr(brace, '}', text.size() - (brace - data)));
+            pos = close ? close - data + 1 : text.size();
             continue;
         }
+        pos = std::min(lineEnd + 1, text.size());
+        if (pos < text.size() && text[pos] == '[') {
+            // The tag is left for the next game
+            end = lineEnd;
+            break;
+        }
+    }
+    while (end > begin && std::isspace((unsigned char)text[end - 1]))
+        end--;
+    game.movetext = text.substr(begin, end - begin);
+}
+
+bool Reader::next(Game& game) {
+    game.tags.clear();
+    game.movetext = {};
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (c == '[') {
+            Tag tag;
+            if (readTag(tag))
+                game.tags.push_back(tag);
+        } else if (c == '%') {
+            // Escaped lines are for other programs
+            skipLine();
+        } else if (std::isspace((unsigned char)c)) {
+            pos++;
+        } else {
+            break;
+        }
+    }
+    if (pos >= text.size() && game.tags.empty())
+        return false;
+    readMovetext(game);
+    return true;
+}
+
+bool isDelimiter(const char c) {
+    switch (c) {
+    case ' ': case '\t': case '\n': case '\r': case '{': case '}': case '(': case ')': case ';':
+    case '$':
+        return true;
+    default:
+        return false;
+    }
+}
+
+Token Lexer::next() {
+    while (pos < text.size()) {
+        char c = text[pos];
+        size_t begin = pos;
+        switch (c) {
+        case ' ': case '\t': case '\n': case '\r':
+            pos++;
+            continue;
+        case '{': {
+            size_t close = text.find('}', pos);
+            pos = close == std::string_view::npos ? text.size() : close + 1;
+            return {TokenType::Comment, text.substr(begin + 1, std::min(close, text.size()) - begin - 1)};
+        }
+        case ';': {
+            size_t newline = text.find('\n', pos);
+            pos = newline == std::string_view::npos ? text.size() : newline + 1;
+            return {TokenType::Comment, text.substr(begin + 1, std::min(newline, text.size()) - begin - 1)};
+        }
+        case '(':
+            pos++;
+            return {TokenType::VariationStart, text.substr(begin, 1)};
+        case ')':
+            pos++;
+            return {TokenType::VariationEnd, text.substr(begin, 1)};
+        case '}':
+            // Stray, the comment it closes has already ended
+            pos++;
+            continue;
+        case '*':
+            pos++;
+            return {TokenType::Result, text.substr(begin, 1)};
+        case '$':
+        case '!':
+        case '?':
+            pos++;
+            while (pos < text.size() && (std::isdigit((unsigned char)text[pos]) || text[pos] == '!' ||
+                                         text[pos] == '?'))
+                pos++;
+            return {TokenType::Nag, text.substr(begin, pos - begin)};
+        default:
+            break;
+        }
+        // Move numbers, "12." or "12...", may run straight into the move
+        if (std::isdigit((unsigned char)c)) {
+            size_t i = pos;
+            while (i < text.size() && std::isdigit((unsigned char)text[i]))
+                i++;
+            if (i < text.size() && text[i] == '.') {
+                while (i < text.size() && text[i] == '.')
+                    i++;
+                pos = i;
+                return {TokenType::MoveNumber, text.substr(begin, pos - begin)};
+            }
+        }
+        while (pos < text.size() && !isDelimiter(text[pos]))
+            pos++;
+        std::string_view word = text.substr(begin, pos - begin);
+        if (word == "1-0" || word == "0-1" || word == "1/2-1/2")
+            return {TokenType::Result, word};
+        return {TokenType::Move, word};
+    }
+    return {TokenType::End, {}};
+}
+
+bool Lexer::nextMove(std::string_view& san) {
+    while (true) {
+        Token token = next();
+        switch (token.type) {
+        case TokenType::End:
+        case TokenType::Result:
+            return false;
+        case TokenType::VariationStart:
+            variationDepth++;
+            break;
+        case TokenType::VariationEnd:
+            variationDepth = std::max(0, variationDepth - 1);
+            break;
+        case TokenType::Move:
+            if (variationDepth == 0) {
+                san = token.text;
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+GameResult parseResult(std::string_view result) {
+    if (result == "1-0")
+        return GameResult::WhiteWin;
+    if (result == "1/2-1/2")
+        return GameResult::Draw;
+    if (result == "0-1")
+        return GameResult::BlackWin;
+    return GameResult::InProgress;
+}
+
+/* Reads the PGN files in the tests folder and replays every game */
+bool sameGame(const PGNInfo& a, const PGNInfo& b) {
+    return a.header.event == b.header.event && a.header.date == b.header.date &&
+           a.header.round == b.header.round && a.header.players[0] == b.header.players[0] &&
+           a.header.players[1] == b.header.players[1] && a.header.result == b.header.result &&
+           a.valid == b.valid && a.moves == b.moves;
+}
+
+/* Imports copies of the test files with several threads and chunks of one or a few games, so
+   chunks finish out of order and get parked, and checks the games arrive exactly as a
+   sequential read returns them */
+void importTest(const char* const (&files)[4]) {
+    std::ostringstream text;
+    for (int copy = 0; copy < 16; copy++) {
+        for (const char* path : files) {
+            std::ifstream file(path, std::ios::binary);
+            text << file.rdbuf() << "\n\n";
+        }
+    }
+    std::string path = (std::filesystem::temp_directory_path() / "cegui_test.pgn").string();
+    std::ofstream(path, std::ios::binary) << text.str();
+
+    std::vector<PGNInfo> expected;
+    Reader reader;
+    Game game;
+    int failures = !reader.open(path);
+    while (reader.next(game))
+        expected.emplace_back(game);
+
+    for (size_t chunkSize : {1, 2000}) {
+        ImportSettings settings;
+        settings.threads = 4;
+        settings.chunkSize = chunkSize;
+        std::vector<PGNInfo> imported;
+        long long count = import(path, [&](const PGNInfo& info, int) {
+            imported.push_back(info);
+        }, settings);
+        bool same = count == (long long)expected.size() && imported.size() == expected.size();
+        for (size_t i = 0; same && i < imported.size(); i++)
+            same = sameGame(imported[i], expected[i]);
+        if (!same) {
+            std::cout << "PGN import test failed with " << chunkSize << " byte chunks\n";
+            failures++;
+        }
+    }
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    std::cout << "PGN import test: " << failures << " failures in " << expected.size()
+              << " games\n";
+}
+
+void test() {
+    const char* files[] = {"tests/test_pgn_fischer.txt", "tests/test_pgn_with_comments.txt",
+                           "tests/test_pgn_without_comments.txt", "tests/test_random_pgn.txt"};
+    int games = 0, moves = 0, failures = 0;
+    for (const char* path : files) {
+        Reader reader;
+        if (!reader.open(path)) {
+            failures++;
+            continue;
+        }
+        Game game;
+        while (reader.next(game)) {
+            PGNInfo info(game);
+            games++;
+            moves += info.moves.size();
+            if (!info.valid || info.header.result == GameResult::InProgress) {
+                std::cout << "PGN test failed: game " << games << " in " << path << "\n";
+                failures++;
+            }
+        }
+    }
+    std::cout << "PGN test: " << failures << " failures in " << games << " games, " << moves
+              << " moves\n";
+    importTest(files);
+}
+
+} // namespace PGN
+
+PGNHeader::PGNHeader(const PGN::Game& game) {
+    for (const PGN::Tag& tag : game.tags) {
+        const std::string_view& key = tag.name;
+        const std::string_view& value = tag.value;
+        // Unknown values are left empty, a date is unknown when all of it is
+        if (value == "?" || value == "????.??.??")
+            continue;
 
         if (key == "Event")
             event = value;
@@ -35,115 +332,306 @@ PGNHeader::PGNHeader(const std::string& headerStr) {
         else if (key == "Date")
             date = value;
         else if (key == "Round")
-            round = std::stoi(value);
+            round = value;
         else if (key == "White")
             players[0] = value;
         else if (key == "Black")
             players[1] = value;
         else if (key == "Result")
-            parseResult(value);
-
-        header = match.suffix();
+            result = PGN::parseResult(value);
+        else if (key == "FEN")
+            fen = value;
     }
 }
 
-void PGNHeader::parseResult(const std::string& result_str) {
-    if (result_str == "1-0")
-        result = GameResult::WhiteWin;
-    else if (result_str == "1/2-1/2")
-        result = GameResult::Draw;
-    else if (result_str == "0-1")
-        result = GameResult::BlackWin;
-    else if (result_str == "*")
-        result = GameResult::InProgress;
+PGNInfo::PGNInfo(const PGN::Game& game) : header(game) {
+    Board board(header.fen.empty() ? Board::position[1] : header.fen);
+    PGN::Lexer lexer(game.movetext);
+    std::string_view san;
+    while (lexer.nextMove(san)) {
+        int move = Move::parseSAN(san, board);
+        if (!move) {
+            valid = false;
+            return;
+        }
+        moves.push_back(move);
+        Move::make(&board, move, Move::MoveType::allMoves);
+    }
 }
 
-PGNInfo::PGNInfo(const std::string& headerStr, const std::string& movesStr)
-    : header(PGNHeader(headerStr)), moves({}) {
-    std::regex rgx(MOVE_PATTERN);
-    std::smatch match;
-    std::string moves = movesStr;
-    bool isWhiteToMove = true;
-    int count = 0;
-    while (std::regex_search(moves, match, rgx)) {
-        count++;
-        std::cout << count << ". " << match[0]
-                  << "\n================================================\n";
-        MoveInfo move(match, isWhiteToMove);
-        move.printInfo();
+namespace PGN {
 
-        moves = match.suffix();
-        isWhiteToMove = !isWhiteToMove;
+// Finished chunks that may wait for an earlier one before new chunks stop being started, per
+// thread. It bounds the memory an ordered import holds on to behind a slow chunk
+constexpr size_t CHUNKS_AHEAD = 4;
+
+/* Chunk boundaries: roughly every 'chunkSize' bytes, moved forward to the next '[Event ' line.
+   Such a line inside a comment would split a game, which real files don't do */
+std::vector<size_t> splitChunks(std::string_view text, const size_t chunkSize) {
+    std::vector<size_t> bounds = {0};
+    size_t pos = chunkSize;
+    while (pos < text.size()) {
+        size_t found = text.find("\n[Event ", pos - 1);
+        if (found == std::string_view::npos)
+            break;
+        bounds.push_back(found + 1);
+        pos = found + 1 + chunkSize;
     }
+    bounds.push_back(text.size());
+    return bounds;
+}
+
+long long import(const std::string& path, const Sink& sink, const ImportSettings& settings) {
+    MappedFile file;
+    if (!file.open(path))
+        return -1;
+    std::string_view text(file.data, file.size);
+    std::vector<size_t> bounds = splitChunks(text, std::max<size_t>(1, settings.chunkSize));
+    size_t chunks = bounds.size() - 1;
+    int threads = std::min<int>(Parallel::threadCount(settings.threads), chunks);
+    bool ordered = settings.order == Order::Kept;
+
+    std::atomic<size_t> nextChunk = 0;
+    std::atomic<long long> games = 0;
+    // Ordered imports park each chunk's games until every earlier chunk has been delivered
+    std::vector<std::vector<PGNInfo>> parked(ordered ? chunks : 0);
+    std::vector<bool> finished(ordered ? chunks : 0);
+    size_t delivered = 0;
+    std::mutex mutex;
+    std::condition_variable progress;
+
+    auto work = [&](const int thread) {
+        Game game;
+        for (size_t chunk; (chunk = nextChunk++) < chunks;) {
+            if (ordered) {
+                std::unique_lock<std::mutex> lock(mutex);
+                progress.wait(lock, [&] { return chunk < delivered + CHUNKS_AHEAD * threads; });
+            }
+            Reader reader(text.substr(bounds[chunk], bounds[chunk + 1] - bounds[chunk]));
+            std::vector<PGNInfo> replayed;
+            while (reader.next(game)) {
+                games++;
+                if (ordered)
+                    replayed.emplace_back(game);
+                else
+                    sink(PGNInfo(game), thread);
+            }
+            if (!ordered)
+                continue;
+
+            // Whoever finishes the oldest outstanding chunk delivers it and any that were
+            // waiting on it, holding the lock so the sink is only ever called by one thread
+            std::lock_guard<std::mutex> lock(mutex);
+            parked[chunk] = std::move(replayed);
+            finished[chunk] = true;
+            while (delivered < chunks && finished[delivered]) {
+                for (const PGNInfo& info : parked[delivered])
+                    sink(info, thread);
+                std::vector<PGNInfo>().swap(parked[delivered]);
+                delivered++;
+            }
+            progress.notify_all();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(work, t);
+    work(0);
+    for (std::thread& thread : pool)
+        thread.join();
+    return games;
 }
 
-MoveInfo::MoveInfo(const std::smatch& match, bool isWhiteToMove) {
-    parseMoves(match, isWhiteToMove);
+void writeMovetext(std::ostream& out, const Board& start, const std::vector<std::string>& san,
+                   const std::vector<std::string>& comments, const std::string& result,
+                   const std::string& ending) {
+    int moveNumber = std::max(1, start.state.fullMoves);
+    bool white = start.state.side == PieceColor::LIGHT;
+    std::string line;
+    auto addWord = [&](const std::string& word) {
+        // Lines are kept under 80 characters
+        if (!line.empty() && line.size() + 1 + word.size() > 79) {
+            out << line << "\n";
+            line.clear();
+        }
+        line += (line.empty() ? "" : " ") + word;
+    };
+    for (size_t i = 0; i < san.size(); i++) {
+        if (white)
+            addWord(std::to_string(moveNumber) + ".");
+        else if (i == 0)
+            addWord(std::to_string(moveNumber) + "...");
+        addWord(san[i]);
+        if (i < comments.size())
+            addWord("{" + comments[i] + "}");
+        if (!white)
+            moveNumber++;
+        white = !white;
+    }
+    if (!ending.empty())
+        addWord("{" + ending + "}");
+    addWord(result);
+    out << line << "\n\n";
 }
 
-void MoveInfo::parseMoves(const std::smatch& match, bool isWhiteToMove) {
-    if (!match[8].str().empty()) {
-        piece = Piece::K;
-        promoted = Piece::E;
-        disambiguate = 0;
+} // namespace PGN
+
+/* Reads the text from the end: check marks and annotations, then the promotion, the target
+   square and whatever is left in front of it */
+bool MoveInfo::parse(std::string_view san) {
+    *this = MoveInfo();
+    while (!san.empty() && (san.back() == '!' || san.back() == '?'))
+        san.remove_suffix(1);
+    if (!san.empty() && (san.back() == '+' || san.back() == '#')) {
+        annotation = san.back() == '#' ? MoveAnnotation::Checkmate : MoveAnnotation::Check;
+        san.remove_suffix(1);
+    }
+    if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0") {
+        piece = PieceTypes::KING;
         type = MoveType::Castling;
-        target = Sq::g1;
-        return;
+        queenside = san.size() == 5;
+        return true;
     }
 
-    PieceTypes pieceType = PieceTypes::PAWN;
-    // Piece
-    switch (match[1].str()[0]) {
-    case 'N':
-        pieceType = PieceTypes::KNIGHT;
-        break;
-    case 'B':
-        pieceType = PieceTypes::BISHOP;
-        break;
-    case 'R':
-        pieceType = PieceTypes::ROOK;
-        break;
-    case 'Q':
-        pieceType = PieceTypes::QUEEN;
-        break;
-    case 'K':
-        pieceType = PieceTypes::KING;
-        break;
+    size_t begin = 0, end = san.size();
+    switch (end > 0 ? san[0] : ' ') {
+    case 'N': piece = PieceTypes::KNIGHT; begin++; break;
+    case 'B': piece = PieceTypes::BISHOP; begin++; break;
+    case 'R': piece = PieceTypes::ROOK; begin++; break;
+    case 'Q': piece = PieceTypes::QUEEN; begin++; break;
+    case 'K': piece = PieceTypes::KING; begin++; break;
+    default: break;
+    }
+    // Promotion, with or without the '='
+    if (end > begin && piece == PieceTypes::PAWN) {
+        switch (san[end - 1]) {
+        case 'N': promoted = Piece::N; break;
+        case 'B': promoted = Piece::B; break;
+        case 'R': promoted = Piece::R; break;
+        case 'Q': promoted = Piece::Q; break;
+        default: break;
+        }
+        if (promoted != Piece::E && --end > begin && san[end - 1] == '=')
+            end--;
     }
-    piece = (Piece)(isWhiteToMove ? (int)pieceType : (int)pieceType + 6);
-    disambiguate = match[2].str()[0];
+    if (end < begin + 2)
+        return false;
+    char file = san[end - 2], rank = san[end - 1];
+    if (file < 'a' || file > 'h' || rank < '1' || rank > '8')
+        return false;
+    target = (Sq)SQ(8 - (rank - '0'), file - 'a');
 
-    for (int i = 0; i < 64; i++) {
-        if (match[4] == strCoords[i])
-            target = (Sq)i;
+    bool capture = false;
+    for (size_t i = begin; i < end - 2; i++) {
+        char c = san[i];
+        if (c >= 'a' && c <= 'h')
+            fromFile = c - 'a';
+        else if (c >= '1' && c <= '8')
+            fromRank = 8 - (c - '0');
+        else if (c == 'x' || c == ':')
+            capture = true;
+        else if (c != '-')
+            return false;
+    }
+    bool promotion = promoted != Piece::E;
+    type = capture && promotion ? MoveType::CapturePromotion
+           : capture            ? MoveType::Capture
+           : promotion          ? MoveType::Promotion
+                                : MoveType::Quiet;
+    return true;
+}
+
+/* Finds the source by looking back from the target square with the attack tables, the way a
+   piece of that kind on the target would attack, instead of generating every move. Only when
+   several pieces fit does the pin check pick the one that can legally move */
+int MoveInfo::resolve(const Board& board) const {
+    bool white = board.state.side == PieceColor::LIGHT;
+    int offset = white ? 0 : 6;
+    if (type == MoveType::Castling) {
+        Move::MoveList moveList;
+        if (white)
+            Move::genWhiteCastling(moveList, board);
+        else
+            Move::genBlackCastling(moveList, board);
+        for (int i = 0; i < moveList.count; i++) {
+            int move = moveList.list[i];
+            if ((COL(Move::getTarget(move)) == 2) == queenside && Move::isLegal(board, move))
+                return move;
+        }
+        return 0;
     }
 
-    if (!match[3].str().empty() && !match[5].str().empty())
-        type = MoveType::CapturePromotion;
-    else if (!match[3].str().empty())
-        type = MoveType::Capture;
-    else if (!match[5].str().empty())
-        type = MoveType::Promotion;
-    else
-        type = MoveType::Quiet;
+    int to = (int)target;
+    uint64_t occupancy = board.pos.units[(int)PieceColor::BOTH];
+    if (getBit(board.pos.units[(int)board.state.side], to))
+        return 0;
+    bool enpassant = piece == PieceTypes::PAWN && to == (int)board.state.enpassant;
+    bool capture = enpassant || getBit(board.pos.units[(int)board.state.xside], to);
+    // The capture mark has to agree with the board, and a pawn capture always names its file
+    if (capture != (type == MoveType::Capture || type == MoveType::CapturePromotion))
+        return 0;
+    if (capture && piece == PieceTypes::PAWN && fromFile < 0)
+        return 0;
+    int pieceIndex = (int)piece + offset;
+    uint64_t ours = board.pos.pieces[pieceIndex];
 
-    if (type == MoveType::Promotion || type == MoveType::CapturePromotion) {
-        size_t ind = pieceStr.find(match[6]);
-        if (ind != std::string::npos)
-            promoted = (Piece)ind;
+    uint64_t sources = 0;
+    bool twoSquarePush = false;
+    switch (piece) {
+    case PieceTypes::PAWN: {
+        if (capture) {
+            // Our pawns that attack the target are where an enemy pawn on it would attack
+            sources = Attack::pawnAttacks[(int)board.state.xside][to] & ours;
+            break;
+        }
+        // White pawns move towards lower square indices
+        int behind = white ? to + 8 : to - 8;
+        if (behind < 0 || behind > 63)
+            return 0;
+        if (getBit(ours, behind)) {
+            sources = 1ULL << behind;
+        } else if (!getBit(occupancy, behind) && ROW(to) == (white ? 4 : 3)) {
+            int start = white ? behind + 8 : behind - 8;
+            sources = ours & (1ULL << start);
+            twoSquarePush = true;
+        }
+        break;
+    }
+    case PieceTypes::KNIGHT: sources = Attack::knightAttacks[to] & ours; break;
+    case PieceTypes::BISHOP: sources = Magics::getBishopAttack(to, occupancy) & ours; break;
+    case PieceTypes::ROOK: sources = Magics::getRookAttack(to, occupancy) & ours; break;
+    case PieceTypes::QUEEN: sources = Magics::getQueenAttack(to, occupancy) & ours; break;
+    case PieceTypes::KING: sources = Attack::kingAttacks[to] & ours; break;
     }
 
-    if (match[7] == "#")
-        annotation = MoveAnnotation::Checkmate;
-    else if (match[7] == "+")
-        annotation = MoveAnnotation::Check;
+    // A pawn reaching the last rank has to promote, and nothing else may
+    bool lastRank = ROW(to) == (white ? 0 : 7);
+    if ((piece == PieceTypes::PAWN && lastRank) != (promoted != Piece::E))
+        return 0;
+    int promotedPiece = promoted == Piece::E ? (int)Piece::E : (int)promoted + offset;
+
+    while (sources) {
+        int source = Bitboard::lsbIndex(sources);
+        sources &= sources - 1;
+        if ((fromFile >= 0 && COL(source) != fromFile) || (fromRank >= 0 && ROW(source) != fromRank))
+            continue;
+        int move = Move::encode(source, to, pieceIndex, promotedPiece, capture, twoSquarePush,
+                                enpassant, false);
+        if (Move::isLegal(board, move))
+            return move;
+    }
+    return 0;
 }
 
-void MoveInfo::printInfo() {
+void MoveInfo::printInfo() const {
     std::cout << "        Piece: " << pieceStr[(int)piece] << "\n";
     std::cout << "     Promoted: " << pieceStr[(int)promoted] << "\n";
     std::cout << "  Annotations: " << (int)annotation << "\n";
     std::cout << "         Type: " << (int)type << "\n";
-    std::cout << "       Target: " << strCoords[(int)target] << "\n";
-    std::cout << " Disambiguate: " << disambiguate << "\n\n";
+    std::cout << "       Target: " << (type == MoveType::Castling ? (queenside ? "O-O-O" : "O-O")
+                                                                  : strCoords[(int)target])
+              << "\n";
+    std::cout << " Disambiguate: " << (fromFile >= 0 ? std::string(1, 'a' + fromFile) : "")
+              << (fromRank >= 0 ? std::string(1, '8' - fromRank) : "") << "\n\n";
 }
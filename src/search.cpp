@@ -0,0 +1,864 @@
+#include "search.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+#include "bitboard.hpp"
+#include "eval.hpp"
+#include "move.hpp"
+#include "options.hpp"
+#include "see.hpp"
+#include "tablebase.hpp"
+#include "tt.hpp"
+
+namespace Search {
+
+std::atomic<bool> stopped = false;
+std::atomic<bool> pondering = false;
+// Set while a search started by 'start' hasn't returned
+std::atomic<bool> running = false;
+// Set right before 'pondering' is cleared, so it's valid whenever pondering is seen as false
+std::atomic<long long> ponderhitTime = 0;
+bool silent = false;
+std::function<void(const Info&)> onInfo;
+
+// All workers of the current search, the first one is the main thread
+std::vector<std::unique_ptr<Worker>> workers;
+
+long long now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+Worker::Worker(const int id, const Board& b, const Limits& l) : id(id), board(b), limits(l) {
+    // The caller's accumulator is stale if the network was loaded after the position was set
+    Eval::refresh(board);
+}
+
+uint64_t totalNodes() {
+    uint64_t total = 0;
+    for (auto& worker : workers)
+        total += worker->nodes.load(std::memory_order_relaxed);
+    return total;
+}
+
+/* While pondering the clock isn't ours, so the time limits are suspended. On a ponderhit they
+   start counting from the moment of the hit */
+bool Worker::isPondering() {
+    if (!limits.ponder)
+        return false;
+    if (pondering)
+        return true;
+    limits.ponder = false;
+    timeManager.init(limits, board.state.side, ponderhitTime);
+    return false;
+}
+
+/* Static evaluation through the thread's cache, transpositions reach the same leaves often */
+int Worker::evaluate() {
+    int score;
+    STATS_INC(evalProbes);
+    if (evalCache.probe(board.state.key, score)) {
+        STATS_INC(evalHits);
+        return score;
+    }
+    score = Eval::evaluate(board);
+    // Entries only hold 16 bits, which any sane evaluation fits in
+    if (score == (int16_t)score)
+        evalCache.store(board.state.key, score);
+    return score;
+}
+
+/* Only the main thread enforces the limits, helpers just follow the 'stopped' flag */
+void Worker::checkLimits() {
+    if (id != 0)
+        return;
+    uint64_t count = nodes.load(std::memory_order_relaxed);
+    if ((count & 1023) == 0 && isPondering())
+        return;
+    if (limits.nodes && workers.size() == 1 && count >= limits.nodes)
+        stopped = true;
+    // Summing every thread's counter is costly, so with helpers it's done every 1024 nodes
+    if (limits.nodes && workers.size() > 1 && (count & 1023) == 0 && totalNodes() >= limits.nodes)
+        stopped = true;
+    // Reading the clock is far more expensive than a node, so only do it every 1024 nodes. The
+    // first iteration always completes, so even a tiny budget yields a move
+    if ((count & 1023) == 0 && completedDepth > 0 && timeManager.hardLimitReached())
+        stopped = true;
+}
+
+/* Detects fifty move draws and repetitions of a position on the current search path */
+bool Worker::isDraw() const {
+    if (board.state.halfMoves >= 100)
+        return true;
+    // Only positions since the last capture or pawn move can repeat, and only with the same
+    // side to move. Negative indices reach back into the game before the root
+    int first = ply - board.state.halfMoves;
+    // A null move doesn't reset the fifty move counter, but a position after it repeating one
+    // from before it isn't a real repetition, so the scan stops there
+    for (int i = ply - 1; i >= std::max(first, 0); i--) {
+        if (moveStack[i] == 0) {
+            first = i + 1;
+            break;
+        }
+    }
+    int historySize = gameHistory.size();
+    for (int i = ply - 2; i >= first && historySize + i >= 0; i -= 2) {
+        if ((i >= 0 ? keyStack[i] : gameHistory[historySize + i]) == board.state.key)
+            return true;
+    }
+    return false;
+}
+
+// Mate and tablebase scores are stored relative to the node rather than the root, so that they
+// stay correct when the same position is reached at a different ply
+int scoreToTT(const int score, const int ply) {
+    if (score >= TB_WIN_SCORE)
+        return score + ply;
+    if (score <= -TB_WIN_SCORE)
+        return score - ply;
+    return score;
+}
+
+int scoreFromTT(const int score, const int ply) {
+    if (score >= TB_WIN_SCORE)
+        return score - ply;
+    if (score <= -TB_WIN_SCORE)
+        return score + ply;
+    return score;
+}
+
+// Move ordering scores, from the first move searched to the last
+constexpr int HASH_MOVE_SCORE = 2000000;
+constexpr int GOOD_CAPTURE_SCORE = 1000000;
+constexpr int FIRST_KILLER_SCORE = 900000;
+constexpr int SECOND_KILLER_SCORE = 800000;
+constexpr int COUNTER_MOVE_SCORE = 700000;
+constexpr int BAD_CAPTURE_SCORE = -1000000;
+// History scores saturate at this value, so they always stay between the other categories
+constexpr int MAX_HISTORY = 16384;
+
+bool isQuiet(const int move) {
+    return !Move::isCapture(move) && Move::getPromoted(move) == (int)Piece::E;
+}
+
+/* Most valuable victim, least valuable attacker */
+int mvvLva(const Board& board, const int move) {
+    int victim = Move::isEnpassant(move) ? (int)PieceTypes::PAWN
+                                         : COLORLESS(board.pos.getPieceOnSquare(Move::getTarget(move)));
+    return victim * 8 + (int)PieceTypes::KING - COLORLESS(Move::getPiece(move));
+}
+
+void Worker::scoreMoves(Move::MoveList& moveList, const int ttMove) const {
+    int side = (int)board.state.side;
+    int previous = ply > 0 ? moveStack[ply - 1] : 0;
+    int counterMove =
+        previous ? counterMoves[Move::getPiece(previous)][Move::getTarget(previous)] : 0;
+
+    for (int i = 0; i < moveList.count; i++) {
+        int move = moveList.list[i];
+        int& score = moveList.scores[i];
+        if (move == ttMove) {
+            score = HASH_MOVE_SCORE;
+        } else if (Move::isCapture(move)) {
+            // Captures of a piece worth at least the capturer can't lose material
+            int victim = Move::isEnpassant(move)
+                             ? (int)PieceTypes::PAWN
+                             : COLORLESS(board.pos.getPieceOnSquare(Move::getTarget(move)));
+            bool good = See::seeValue[victim] >= See::seeValue[COLORLESS(Move::getPiece(move))] ||
+                        See::evaluate(board, move) >= 0;
+            score = (good ? GOOD_CAPTURE_SCORE : BAD_CAPTURE_SCORE) + mvvLva(board, move);
+        } else if (Move::getPromoted(move) != (int)Piece::E) {
+            score = COLORLESS(Move::getPromoted(move)) == (int)PieceTypes::QUEEN
+                        ? GOOD_CAPTURE_SCORE
+                        : BAD_CAPTURE_SCORE;
+        } else if (move == killers[ply][0]) {
+            score = FIRST_KILLER_SCORE;
+        } else if (move == killers[ply][1]) {
+            score = SECOND_KILLER_SCORE;
+        } else if (move == counterMove) {
+            score = COUNTER_MOVE_SCORE;
+        } else {
+            score = history[side][Move::getSource(move)][Move::getTarget(move)];
+        }
+    }
+}
+
+void Worker::scoreCaptures(Move::MoveList& moveList) const {
+    for (int i = 0; i < moveList.count; i++)
+        moveList.scores[i] = mvvLva(board, moveList.list[i]);
+}
+
+/* Rewards a quiet move that caused a beta cutoff and penalizes the quiet moves searched
+   before it, which failed to */
+void Worker::updateQuietStats(const int move, const int depth, const int* quiets,
+                              const int quietCount) {
+    if (killers[ply][0] != move) {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = move;
+    }
+    if (ply > 0 && moveStack[ply - 1])
+        counterMoves[Move::getPiece(moveStack[ply - 1])][Move::getTarget(moveStack[ply - 1])] =
+            move;
+
+    int side = (int)board.state.side;
+    int bonus = std::min(depth * depth, 1200);
+    // The update is scaled down as an entry approaches the limit, so it can never overflow it
+    auto update = [&](int m, int delta) {
+        int& entry = history[side][Move::getSource(m)][Move::getTarget(m)];
+        entry += delta - entry * std::abs(delta) / MAX_HISTORY;
+    };
+    update(move, bonus);
+    for (int i = 0; i < quietCount; i++) {
+        if (quiets[i] != move)
+            update(quiets[i], -bonus);
+    }
+}
+
+// Late move reductions grow with both the depth and the number of moves already searched
+const auto reductions = [] {
+    std::array<std::array<int, 64>, MAX_PLY> table{};
+    for (int depth = 1; depth < MAX_PLY; depth++) {
+        for (int moveCount = 1; moveCount < 64; moveCount++)
+            table[depth][moveCount] = (int)(0.75 + std::log(depth) * std::log(moveCount) / 2.25);
+    }
+    return table;
+}();
+
+// Futility margins by remaining depth
+constexpr std::array<int, 4> futilityMargin = {0, 200, 300, 500};
+constexpr int REVERSE_FUTILITY_MARGIN = 80;
+
+/* Null move pruning is unsound in zugzwang, which practically only happens when the side to
+   move has nothing but pawns left */
+bool hasNonPawnMaterial(const Board& board) {
+    int offset = board.state.side == PieceColor::LIGHT ? 0 : 6;
+    for (int piece = (int)PieceTypes::KNIGHT; piece <= (int)PieceTypes::QUEEN; piece++) {
+        if (board.pos.pieces[piece + offset])
+            return true;
+    }
+    return false;
+}
+
+int Worker::negamax(int alpha, int beta, int depth) {
+    pvLength[ply] = ply;
+    keyStack[ply] = board.state.key;
+
+    checkLimits();
+    if (stopped)
+        return 0;
+    nodes.fetch_add(1, std::memory_order_relaxed);
+
+    if (ply > 0 && isDraw())
+        return 0;
+
+    bool inCheck = board.isOppInCheck();
+    // Check extension: don't let a check push the position into the quiescence search
+    if (inCheck && features.checkExtensions)
+        depth++;
+
+    if (depth <= 0)
+        return quiescence(alpha, beta);
+    if (ply >= MAX_PLY - 1)
+        return evaluate();
+
+    bool pvNode = beta - alpha > 1;
+    TT::Entry ttEntry;
+    int ttMove = 0;
+    ttProbes++;
+    if (TT::probe(board.state.key, ttEntry)) {
+        ttHits++;
+        ttMove = ttEntry.move;
+        // Cut off with the stored result if it was searched at least as deep and its bound
+        // settles this window. PV nodes always search, so the PV stays complete
+        int ttScore = scoreFromTT(ttEntry.score, ply);
+        if (!pvNode && ply > 0 && ttEntry.depth >= depth &&
+            (ttEntry.bound == TT::Bound::Exact ||
+             (ttEntry.bound == TT::Bound::Lower && ttScore >= beta) ||
+             (ttEntry.bound == TT::Bound::Upper && ttScore <= alpha))) {
+            STATS_INC(ttCutoffs);
+            return ttScore;
+        }
+    }
+
+    // The tables know the result outright. They ignore castling and en passant, so positions
+    // where either is possible aren't probed
+    Tablebase::WDL wdl;
+    if (ply > 0 && !board.state.castling && board.state.enpassant == Sq::noSq &&
+        Bitboard::countBits(board.pos.units[(int)PieceColor::BOTH]) <= Tablebase::maxMen &&
+        Tablebase::probeWDL(board, wdl)) {
+        int score = wdl == Tablebase::WDL::Win    ? TB_WIN - ply
+                    : wdl == Tablebase::WDL::Loss ? -TB_WIN + ply
+                                                  : 0;
+        TT::store(board.state.key, 0, scoreToTT(score, ply), depth, TT::Bound::Exact);
+        return score;
+    }
+
+    int staticEval = inCheck ? -INF : evaluate();
+    if (!pvNode && !inCheck && ply > 0) {
+        // Reverse futility pruning: far enough above beta that no move will bring it back
+        if (features.futility && depth <= 6 && std::abs(beta) < MATE_SCORE &&
+            staticEval - REVERSE_FUTILITY_MARGIN * depth >= beta)
+            return staticEval;
+
+        // Null move pruning: if passing the turn still fails high, a real move would too. Never
+        // two null moves in a row
+        if (features.nullMove && depth >= 3 && staticEval >= beta && moveStack[ply - 1] != 0 &&
+            hasNonPawnMaterial(board)) {
+            int reduction = 3 + depth / 6;
+            STATS_INC(nullMoveTries);
+            Board nullClone = board;
+            Move::makeNull(&board);
+            moveStack[ply] = 0;
+            ply++;
+            int score = -negamax(-beta, -beta + 1, depth - 1 - reduction);
+            ply--;
+            board = nullClone;
+            if (stopped)
+                return 0;
+            // Unproven mates found after a null move aren't trusted
+            if (score >= beta) {
+                STATS_INC(nullMoveCutoffs);
+                return score >= MATE_SCORE ? beta : score;
+            }
+        }
+    }
+
+    // Futility pruning: near the horizon, quiet moves can't raise a hopeless position above
+    // alpha, so only captures, promotions and checks are searched
+    bool futile = features.futility && !pvNode && !inCheck && depth < (int)futilityMargin.size() &&
+                  std::abs(alpha) < MATE_SCORE && staticEval + futilityMargin[depth] <= alpha;
+
+    Move::MoveList moveList;
+    Move::generate(moveList, board);
+    scoreMoves(moveList, ttMove);
+
+    int originalAlpha = alpha;
+    int bestScore = -INF;
+    int bestMove = 0;
+    int legalMoves = 0;
+    std::array<int, 64> quiets;
+    int quietCount = 0;
+    Board clone = board;
+    for (int i = 0; i < moveList.count; i++) {
+        int move = moveList.pickNext(i);
+        if (ply == 0 && !isRootMove(move))
+            continue;
+        // Skip moves which leave the king in check
+        if (!Move::make(&board, move, Move::MoveType::allMoves))
+            continue;
+        legalMoves++;
+        bool quiet = isQuiet(move);
+        bool givesCheck = board.isOppInCheck();
+        if (futile && quiet && !givesCheck && legalMoves > 1) {
+            board = clone;
+            continue;
+        }
+        moveStack[ply] = move;
+        ply++;
+
+        int score;
+        // Principal variation search: only the first move is searched with the full window, the
+        // rest are searched with a null window and re-searched if they turn out to beat alpha
+        if (legalMoves == 1) {
+            score = -negamax(-beta, -alpha, depth - 1);
+        } else {
+            // Late move reductions: quiet moves ordered late are unlikely to be best, so search
+            // them shallower first. Moves with a good history are reduced less
+            int reduction = 0;
+            if (features.lmr && depth >= 3 && legalMoves > 3 && quiet && !inCheck && !givesCheck) {
+                reduction = reductions[std::min(depth, MAX_PLY - 1)][std::min(legalMoves, 63)];
+                reduction -= history[(int)clone.state.side][Move::getSource(move)]
+                                    [Move::getTarget(move)] /
+                             8192;
+                if (pvNode)
+                    reduction--;
+                reduction = std::clamp(reduction, 0, depth - 2);
+            }
+            if (reduction > 0)
+                STATS_INC(lmrSearches);
+            score = -negamax(-alpha - 1, -alpha, depth - 1 - reduction);
+            if (reduction > 0 && score > alpha) {
+                STATS_INC(lmrResearches);
+                score = -negamax(-alpha - 1, -alpha, depth - 1);
+            }
+            if (score > alpha && score < beta)
+                score = -negamax(-beta, -alpha, depth - 1);
+        }
+
+        ply--;
+        board = clone;
+        if (stopped)
+            return 0;
+
+        if (score > bestScore) {
+            bestScore = score;
+            if (score > alpha) {
+                alpha = score;
+                bestMove = move;
+                // Copy the child's principal variation behind this move
+                pvTable[ply][ply] = move;
+                for (int next = ply + 1; next < pvLength[ply + 1]; next++)
+                    pvTable[ply][next] = pvTable[ply + 1][next];
+                pvLength[ply] = pvLength[ply + 1];
+                if (score >= beta) {
+                    betaCutoffs++;
+                    if (legalMoves == 1)
+                        firstMoveCutoffs++;
+                    if (isQuiet(move))
+                        updateQuietStats(move, depth, quiets.data(), quietCount);
+                    break;
+                }
+            }
+        }
+        if (isQuiet(move) && quietCount < (int)quiets.size())
+            quiets[quietCount++] = move;
+    }
+
+    // Checkmate or stalemate
+    if (legalMoves == 0)
+        return inCheck ? -MATE_VALUE + ply : 0;
+
+    TT::Bound bound = bestScore >= beta            ? TT::Bound::Lower
+                      : bestScore > originalAlpha ? TT::Bound::Exact
+                                                  : TT::Bound::Upper;
+    // Later MultiPV lines and 'searchmoves' search only some of the root moves, their result
+    // isn't the root's and would replace the real move and score
+    if (ply > 0 || (excludedMoves.empty() && limits.searchMoves.empty()))
+        TT::store(board.state.key, bestMove, scoreToTT(bestScore, ply), depth, bound);
+    return bestScore;
+}
+
+// A capture that can't bring the score back above alpha even with this much positional
+// compensation isn't worth searching
+constexpr int DELTA_MARGIN = 200;
+
+/* Searches captures only until the position is quiet, so that the static evaluation is never
+   taken in the middle of an exchange */
+int Worker::quiescence(int alpha, int beta) {
+    pvLength[ply] = ply;
+
+    checkLimits();
+    if (stopped)
+        return 0;
+    nodes.fetch_add(1, std::memory_order_relaxed);
+    qnodes++;
+
+    // Stand pat: the side to move can usually do at least as well as the static evaluation
+    // by playing a quiet move, so it bounds the score from below
+    int standPat = evaluate();
+    if (standPat >= beta || ply >= MAX_PLY - 1)
+        return standPat;
+    if (standPat > alpha)
+        alpha = standPat;
+
+    Move::MoveList moveList;
+    Move::generateCaptures(moveList, board);
+    scoreCaptures(moveList);
+
+    int bestScore = standPat;
+    Board clone = board;
+    for (int i = 0; i < moveList.count; i++) {
+        int move = moveList.pickNext(i);
+
+        // Delta pruning
+        if (Move::getPromoted(move) == (int)Piece::E) {
+            int captured = Move::isEnpassant(move)
+                               ? (int)PieceTypes::PAWN
+                               : COLORLESS(board.pos.getPieceOnSquare(Move::getTarget(move)));
+            if (standPat + See::seeValue[captured] + DELTA_MARGIN <= alpha)
+                continue;
+        }
+        // Skip captures which lose material
+        if (See::evaluate(board, move) < 0)
+            continue;
+
+        if (!Move::make(&board, move, Move::MoveType::allMoves))
+            continue;
+        ply++;
+        int score = -quiescence(-beta, -alpha);
+        ply--;
+        board = clone;
+        if (stopped)
+            return 0;
+
+        if (score > bestScore) {
+            bestScore = score;
+            if (score > alpha) {
+                alpha = score;
+                if (score >= beta)
+                    break;
+            }
+        }
+    }
+    return bestScore;
+}
+
+// Helper threads skip some depths so that they don't all search the same tree in lockstep.
+// Helper i searches 'skipSize' consecutive depths and then skips as many, offset by 'skipPhase'
+const int skipSize[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+const int skipPhase[] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+bool Worker::skipDepth(const int depth) const {
+    if (id == 0)
+        return false;
+    int i = (id - 1) % 20;
+    return ((depth + skipPhase[i]) / skipSize[i]) % 2;
+}
+
+// Whether the root move is searched: it has to be in 'searchmoves' if that was given, and not
+// in an earlier MultiPV line
+bool Worker::isRootMove(const int move) const {
+    const std::vector<int>& allowed = limits.searchMoves;
+    if (!allowed.empty() && std::find(allowed.begin(), allowed.end(), move) == allowed.end())
+        return false;
+    return std::find(excludedMoves.begin(), excludedMoves.end(), move) == excludedMoves.end();
+}
+
+int countLegalMoves(const Board& board) {
+    Move::MoveList moveList;
+    Move::generate(moveList, board);
+    int count = 0;
+    for (int i = 0; i < moveList.count; i++) {
+        Board clone = board;
+        count += Move::make(&clone, moveList.list[i], Move::MoveType::allMoves);
+    }
+    return count;
+}
+
+#ifdef CEGUI_STATS
+/* Stores what the iteration just completed added to each counter */
+void Worker::recordIteration(const int depth) {
+    Stats::Iteration current;
+    current.depth = depth;
+    current.time = now() - startTime;
+    current.nodes = nodes;
+    current.qnodes = qnodes;
+    current.ttProbes = ttProbes;
+    current.ttHits = ttHits;
+    current.ttCutoffs = ttCutoffs;
+    current.evalProbes = evalProbes;
+    current.evalHits = evalHits;
+    current.betaCutoffs = betaCutoffs;
+    current.firstMoveCutoffs = firstMoveCutoffs;
+    current.nullMoveTries = nullMoveTries;
+    current.nullMoveCutoffs = nullMoveCutoffs;
+    current.lmrSearches = lmrSearches;
+    current.lmrResearches = lmrResearches;
+
+    Stats::Iteration delta = current;
+    delta.nodes -= totals.nodes;
+    delta.qnodes -= totals.qnodes;
+    delta.ttProbes -= totals.ttProbes;
+    delta.ttHits -= totals.ttHits;
+    delta.ttCutoffs -= totals.ttCutoffs;
+    delta.evalProbes -= totals.evalProbes;
+    delta.evalHits -= totals.evalHits;
+    delta.betaCutoffs -= totals.betaCutoffs;
+    delta.firstMoveCutoffs -= totals.firstMoveCutoffs;
+    delta.nullMoveTries -= totals.nullMoveTries;
+    delta.nullMoveCutoffs -= totals.nullMoveCutoffs;
+    delta.lmrSearches -= totals.lmrSearches;
+    delta.lmrResearches -= totals.lmrResearches;
+    iterations.push_back(delta);
+    totals = current;
+}
+#endif
+
+/* Iterative deepening driver, returns the best move of the last completed iteration */
+int Worker::iterate() {
+    int bestMove = 0;
+    int stableIterations = 0;
+    startTime = now();
+    evalCache.allocate();
+    if (id == 0)
+        timeManager.init(limits, board.state.side, startTime);
+    int rootMoves = limits.searchMoves.empty() ? countLegalMoves(board)
+                                               : (int)limits.searchMoves.size();
+    int lineCount = std::max(1, std::min(multiPV, rootMoves));
+
+    for (int depth = 1; depth <= limits.depth && depth < MAX_PLY; depth++) {
+        if (skipDepth(depth))
+            continue;
+
+        std::vector<Line> found;
+        excludedMoves.clear();
+        for (int i = 0; i < lineCount; i++) {
+            int score = negamax(-INF, INF, depth);
+            std::vector<int> linePV(pvTable[0].begin(), pvTable[0].begin() + pvLength[0]);
+            // An interrupted search is only trusted if nothing else is available, and only on
+            // the main thread. A helper's first iteration can be deeper than the main thread's
+            // finished one and would outvote it with a score that means nothing
+            if (stopped) {
+                if (id == 0 && bestMove == 0 && found.empty() && !linePV.empty())
+                    found.push_back({score, linePV});
+                break;
+            }
+            found.push_back({score, linePV});
+            if (linePV.empty())
+                break;
+            excludedMoves.push_back(linePV[0]);
+        }
+        if (found.empty() || (stopped && bestMove != 0))
+            break;
+        std::stable_sort(found.begin(), found.end(),
+                         [](const Line& a, const Line& b) { return a.score > b.score; });
+
+        int previousBest = bestMove;
+        int scoreDrop = completedDepth > 0 ? bestScore - found[0].score : 0;
+        if (!found[0].pv.empty())
+            bestMove = found[0].pv[0];
+        stableIterations = bestMove == previousBest ? stableIterations + 1 : 0;
+        completedDepth = depth;
+        bestScore = found[0].score;
+        pv = found[0].pv;
+        lines = std::move(found);
+
+        if (id == 0) {
+#ifdef CEGUI_STATS
+            recordIteration(depth);
+#endif
+            for (size_t i = 0; i < lines.size(); i++) {
+                Info info;
+                info.depth = depth;
+                info.multipv = i + 1;
+                info.score = lines[i].score;
+                info.nodes = totalNodes();
+                info.time = now() - startTime;
+                info.hashfull = TT::hashfull();
+                info.pv = lines[i].pv;
+                if (onInfo)
+                    onInfo(info);
+                if (!silent)
+                    printInfo(info);
+            }
+        }
+
+        if (stopped)
+            break;
+        // 'go mate' is answered as soon as a short enough mate is proven
+        if (limits.mate && bestScore >= MATE_SCORE &&
+            (MATE_VALUE - bestScore + 1) / 2 <= limits.mate)
+            break;
+        if (id == 0 && !isPondering() && timeManager.stopIteration(stableIterations, scoreDrop))
+            break;
+    }
+    return bestMove;
+}
+
+/* Picks the final move by letting every thread vote for its best move, weighted by how
+   deep it searched and how good it found the move */
+Worker* pickBestWorker() {
+    Worker* best = workers[0].get();
+    // Helpers only search a single line, so the main thread's lines are final
+    if (best->multiPV > 1)
+        return best;
+    // Only workers that finished an iteration have a say
+    auto finished = [](const std::unique_ptr<Worker>& worker) {
+        return worker->completedDepth > 0 && !worker->pv.empty();
+    };
+    int minScore = INF;
+    for (auto& worker : workers) {
+        if (finished(worker))
+            minScore = std::min(minScore, worker->bestScore);
+    }
+
+    std::unordered_map<int, int64_t> votes;
+    for (auto& worker : workers) {
+        if (finished(worker))
+            votes[worker->pv[0]] +=
+                (int64_t)(worker->bestScore - minScore + 14) * worker->completedDepth;
+    }
+    for (auto& worker : workers) {
+        if (!finished(worker))
+            continue;
+        if (best->pv.empty()) {
+            best = worker.get();
+            continue;
+        }
+        // Always prefer a proven mate, otherwise go by the votes
+        if (best->bestScore >= MATE_SCORE || worker->bestScore >= MATE_SCORE) {
+            if (worker->bestScore > best->bestScore)
+                best = worker.get();
+        } else if (votes[worker->pv[0]] > votes[best->pv[0]]) {
+            best = worker.get();
+        }
+    }
+    return best;
+}
+
+/* The expected reply to ponder on is the second PV move. When the PV was cut short, e.g. by a
+   TT cutoff right after the root, it's looked up in the transposition table instead */
+int getPonderMove(const Board& board, const std::vector<int>& pv) {
+    if (pv.size() >= 2)
+        return pv[1];
+    if (pv.empty())
+        return 0;
+    Board next = board;
+    TT::Entry entry;
+    if (!Move::make(&next, pv[0], Move::MoveType::allMoves) || !TT::probe(next.state.key, entry))
+        return 0;
+    // The stored move could belong to a colliding position, so verify it's legal here
+    Move::MoveList moveList;
+    Move::generate(moveList, next);
+    for (int i = 0; i < moveList.count; i++) {
+        if (moveList.list[i] == entry.move && Move::make(&next, entry.move, Move::MoveType::allMoves))
+            return entry.move;
+    }
+    return 0;
+}
+
+/* Plays the tables' choice when the root has one, returns 0 otherwise */
+int tablebaseMove(const Board& board) {
+    int move, dtz;
+    Tablebase::WDL wdl;
+    if (board.state.enpassant != Sq::noSq || !Tablebase::probeRoot(board, move, wdl, dtz))
+        return 0;
+    Info info;
+    info.depth = 1;
+    info.score = wdl == Tablebase::WDL::Win    ? TB_WIN - dtz
+                 : wdl == Tablebase::WDL::Loss ? -TB_WIN + dtz
+                                               : 0;
+    info.hashfull = TT::hashfull();
+    info.pv = {move};
+    if (onInfo)
+        onInfo(info);
+    if (!silent) {
+        printInfo(info);
+        std::cout << "bestmove " << Move::toString(move) << std::endl;
+    }
+    return move;
+}
+
+/* Lazy SMP: every thread searches the same root on its own board copy, sharing only the
+   transposition table. The main thread runs on the caller's thread and owns the limits */
+int run(const Board& board, const Limits& limits, const std::vector<uint64_t>& history) {
+    TT::newSearch();
+
+    Features features;
+    features.nullMove = Options::get("NullMove");
+    features.lmr = Options::get("LMR");
+    features.futility = Options::get("Futility");
+    features.checkExtensions = Options::get("CheckExtensions");
+
+    int threadCount = std::max(1, Options::get("Threads"));
+    workers.clear();
+    for (int i = 0; i < threadCount; i++) {
+        workers.push_back(std::make_unique<Worker>(i, board, limits));
+        workers.back()->features = features;
+        workers.back()->gameHistory = history;
+    }
+    workers[0]->multiPV = Options::get("MultiPV");
+
+    // Analysis and pondering want a real search, everything else can just take the tables' move
+    if (!limits.infinite && !limits.ponder && Options::get("MultiPV") == 1 &&
+        limits.searchMoves.empty()) {
+        int move = tablebaseMove(board);
+        if (move)
+            return move;
+    }
+
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < threadCount; i++)
+        helpers.emplace_back([i] { workers[i]->iterate(); });
+    workers[0]->iterate();
+    // The best move may not be sent while pondering, even if the search has finished
+    while (pondering && !stopped)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    // Helpers have no limits of their own
+    stopped = true;
+    for (std::thread& helper : helpers)
+        helper.join();
+
+    Worker* best = pickBestWorker();
+    int bestMove = best->pv.empty() ? 0 : best->pv[0];
+    if (!silent) {
+        uint64_t nodes = 0, qnodes = 0, probes = 0, hits = 0, cutoffs = 0, firstCutoffs = 0;
+        for (auto& worker : workers) {
+            nodes += worker->nodes;
+            qnodes += worker->qnodes;
+            probes += worker->ttProbes;
+            hits += worker->ttHits;
+            cutoffs += worker->betaCutoffs;
+            firstCutoffs += worker->firstMoveCutoffs;
+        }
+        std::cout << "info string nodes " << nodes << " qnodes " << qnodes << " qnode share "
+                  << (nodes ? qnodes * 100.0 / nodes : 0.0) << "%" << std::endl;
+        std::cout << "info string tt probes " << probes << " hits " << hits << " hitrate "
+                  << (probes ? hits * 100.0 / probes : 0.0) << "%" << std::endl;
+        std::cout << "info string beta cutoffs " << cutoffs << " first move "
+                  << (cutoffs ? firstCutoffs * 100.0 / cutoffs : 0.0) << "%" << std::endl;
+#ifdef CEGUI_STATS
+        std::cout << "info string stats " << Stats::toJson(workers[0]->iterations) << std::endl;
+#endif
+        int ponderMove = getPonderMove(board, best->pv);
+        std::cout << "bestmove " << (bestMove ? Move::toString(bestMove) : "(none)");
+        if (ponderMove)
+            std::cout << " ponder " << Move::toString(ponderMove);
+        std::cout << std::endl;
+    }
+    return bestMove;
+}
+
+int search(const Board& board, const Limits& limits, const std::vector<uint64_t>& history) {
+    stopped = false;
+    pondering = limits.ponder;
+    return run(board, limits, history);
+}
+
+/* The flags are reset before the thread exists, so a 'stop' or 'ponderhit' that arrives right
+   after 'go' can't be overwritten by the search starting up */
+std::thread start(const Board& board, const Limits& limits,
+                  const std::vector<uint64_t>& history) {
+    stopped = false;
+    pondering = limits.ponder;
+    running = true;
+    return std::thread([board, limits, history] {
+        run(board, limits, history);
+        running = false;
+    });
+}
+
+void stop() { stopped = true; }
+
+bool isRunning() { return running; }
+
+/* The opponent played the expected move: keep searching, but on our own clock now */
+void ponderhit() {
+    ponderhitTime = now();
+    pondering = false;
+}
+
+void printStats() {
+#ifdef CEGUI_STATS
+    if (!workers.empty()) {
+        Stats::print(workers[0]->iterations);
+        return;
+    }
+#endif
+    Stats::print({});
+}
+
+void printInfo(const Info& info) {
+    std::cout << "info depth " << info.depth << " multipv " << info.multipv << " score ";
+    if (info.score >= MATE_SCORE)
+        std::cout << "mate " << (MATE_VALUE - info.score + 1) / 2;
+    else if (info.score <= -MATE_SCORE)
+        std::cout << "mate " << -(MATE_VALUE + info.score) / 2;
+    else
+        std::cout << "cp " << info.score;
+    std::cout << " nodes " << info.nodes << " nps "
+              << (info.time > 0 ? info.nodes * 1000 / info.time : info.nodes) << " time "
+              << info.time << " hashfull " << info.hashfull << " pv";
+    for (int move : info.pv)
+        std::cout << " " << Move::toString(move);
+    std::cout << std::endl;
+}
+
+} // namespace Search
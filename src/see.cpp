@@ -0,0 +1,86 @@
+#include "see.hpp"
+
+#include <algorithm>
+
+#include "attack.hpp"
+#include "bitboard.hpp"
+#include "magics.hpp"
+#include "move.hpp"
+
+namespace See {
+
+// The king is worth more than everything else combined, so capturing into a defended square
+// with it is never good
+const std::array<int, 6> seeValue = {100, 320, 330, 500, 900, 20000};
+
+/* Returns every piece of both colors attacking 'sq' given an occupancy. The occupancy is
+   passed separately so sliders behind pieces already removed by an exchange show up */
+uint64_t attackersTo(const Board& board, const int sq, const uint64_t occupancy) {
+    const auto& pieces = board.pos.pieces;
+    uint64_t bishops = pieces[(int)Piece::B] | pieces[(int)Piece::b] | pieces[(int)Piece::Q] |
+                       pieces[(int)Piece::q];
+    uint64_t rooks = pieces[(int)Piece::R] | pieces[(int)Piece::r] | pieces[(int)Piece::Q] |
+                     pieces[(int)Piece::q];
+    return (Attack::pawnAttacks[(int)PieceColor::DARK][sq] & pieces[(int)Piece::P]) |
+           (Attack::pawnAttacks[(int)PieceColor::LIGHT][sq] & pieces[(int)Piece::p]) |
+           (Attack::knightAttacks[sq] & (pieces[(int)Piece::N] | pieces[(int)Piece::n])) |
+           (Attack::kingAttacks[sq] & (pieces[(int)Piece::K] | pieces[(int)Piece::k])) |
+           (Magics::getBishopAttack(sq, occupancy) & bishops) |
+           (Magics::getRookAttack(sq, occupancy) & rooks);
+}
+
+/* Static exchange evaluation: the material balance of the capture sequence on the move's
+   target square, assuming both sides always recapture with their least valuable attacker
+   and may stop whenever continuing would lose material */
+int evaluate(const Board& board, const int move) {
+    int source = Move::getSource(move);
+    int target = Move::getTarget(move);
+    std::array<int, 32> gain{};
+    int depth = 0;
+
+    uint64_t occupancy = board.pos.units[(int)PieceColor::BOTH];
+    if (Move::isEnpassant(move)) {
+        gain[0] = seeValue[(int)PieceTypes::PAWN];
+        popBit(occupancy, target + (board.state.side == PieceColor::LIGHT ? 8 : -8));
+    } else {
+        int captured = board.pos.getPieceOnSquare(target);
+        gain[0] = captured == (int)Piece::E ? 0 : seeValue[COLORLESS(captured)];
+    }
+    popBit(occupancy, source);
+
+    int attacker = COLORLESS(Move::getPiece(move));
+    int side = (int)board.state.xside;
+    uint64_t attackers = attackersTo(board, target, occupancy) & occupancy;
+
+    while (true) {
+        depth++;
+        // Value of the exchange if the piece just moved gets taken
+        gain[depth] = seeValue[attacker] - gain[depth - 1];
+        // Neither side can improve by continuing
+        if (std::max(-gain[depth - 1], gain[depth]) < 0)
+            break;
+
+        // Find the least valuable attacker of the side to recapture
+        uint64_t ours = attackers & board.pos.units[side];
+        if (!ours)
+            break;
+        int offset = side == (int)PieceColor::LIGHT ? 0 : 6;
+        for (attacker = (int)PieceTypes::PAWN; attacker <= (int)PieceTypes::KING; attacker++) {
+            if (ours & board.pos.pieces[attacker + offset])
+                break;
+        }
+        uint64_t from = ours & board.pos.pieces[attacker + offset];
+        occupancy ^= from & -from;
+        // Removing a piece can uncover a slider behind it
+        attackers = attackersTo(board, target, occupancy) & occupancy;
+        side ^= 1;
+        if (depth == (int)gain.size() - 1)
+            break;
+    }
+
+    while (--depth)
+        gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+    return gain[0];
+}
+
+} // namespace See
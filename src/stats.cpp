@@ -0,0 +1,61 @@
+#include "stats.hpp"
+
+#include <cstdio>
+#include <sstream>
+
+namespace Stats {
+
+double percent(const uint64_t part, const uint64_t whole) {
+    return whole ? part * 100.0 / whole : 0.0;
+}
+
+/* Effective branching factor: how many times more nodes this iteration took than the last */
+double branchingFactor(const std::vector<Iteration>& iterations, const size_t i) {
+    if (i == 0 || iterations[i - 1].nodes == 0)
+        return 0.0;
+    return (double)iterations[i].nodes / iterations[i - 1].nodes;
+}
+
+void print(const std::vector<Iteration>& iterations) {
+    if (iterations.empty()) {
+        std::printf("No statistics, either nothing was searched or stats weren't compiled in\n");
+        return;
+    }
+    std::printf("Depth |      Nodes |  QNodes |   EBF | TT hit |  TT cut | Eval hit | First cut | "
+                "Null cut | LMR re\n");
+    for (size_t i = 0; i < iterations.size(); i++) {
+        const Iteration& it = iterations[i];
+        std::printf("%5d | %10llu | %6.1f%% | %5.2f | %5.1f%% | %6.1f%% | %7.1f%% | %8.1f%% | "
+                    "%7.1f%% | %5.1f%%\n",
+                    it.depth, (unsigned long long)it.nodes, percent(it.qnodes, it.nodes),
+                    branchingFactor(iterations, i), percent(it.ttHits, it.ttProbes),
+                    percent(it.ttCutoffs, it.ttProbes), percent(it.evalHits, it.evalProbes),
+                    percent(it.firstMoveCutoffs, it.betaCutoffs),
+                    percent(it.nullMoveCutoffs, it.nullMoveTries),
+                    percent(it.lmrResearches, it.lmrSearches));
+    }
+}
+
+/* Raw counters plus the derived rates, one object per iteration */
+std::string toJson(const std::vector<Iteration>& iterations) {
+    std::ostringstream ss;
+    ss << "[";
+    for (size_t i = 0; i < iterations.size(); i++) {
+        const Iteration& it = iterations[i];
+        if (i > 0)
+            ss << ",";
+        ss << "{\"depth\":" << it.depth << ",\"time\":" << it.time << ",\"nodes\":" << it.nodes
+           << ",\"qnodes\":" << it.qnodes << ",\"ebf\":" << branchingFactor(iterations, i)
+           << ",\"ttProbes\":" << it.ttProbes << ",\"ttHits\":" << it.ttHits
+           << ",\"ttCutoffs\":" << it.ttCutoffs << ",\"evalProbes\":" << it.evalProbes
+           << ",\"evalHits\":" << it.evalHits << ",\"betaCutoffs\":" << it.betaCutoffs
+           << ",\"firstMoveCutoffs\":" << it.firstMoveCutoffs
+           << ",\"nullMoveTries\":" << it.nullMoveTries
+           << ",\"nullMoveCutoffs\":" << it.nullMoveCutoffs << ",\"lmrSearches\":" << it.lmrSearches
+           << ",\"lmrResearches\":" << it.lmrResearches << "}";
+    }
+    ss << "]";
+    return ss.str();
+}
+
+} // namespace Stats
@@ -0,0 +1,883 @@
+#include "tablebase.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "attack.hpp"
+#include "bitboard.hpp"
+#include "magics.hpp"
+#include "mapped_file.hpp"
+#include "move.hpp"
+#include "parallel.hpp"
+
+namespace Tablebase {
+
+int maxMen = 0;
+
+/* File layout, little endian: the header, one uint64 offset per block relative to the end of the
+   offset table, then the blocks. A block codes BLOCK_SIZE entries as (value, run length - 1)
+   byte pairs. Positions that can't occur take the previous entry's value to lengthen the runs */
+struct FileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t blockSize;
+    uint64_t entries;
+    uint64_t blockCount;
+};
+
+constexpr char MAGIC[4] = {'C', 'G', 'T', 'B'};
+constexpr uint32_t VERSION = 2;
+constexpr uint32_t BLOCK_SIZE = 4096;
+// WDL entries are the result + 1, DTZ entries the distance clamped to a byte
+enum Kind { WDL_FILE, DTZ_FILE };
+const std::array<std::string, 2> extensions = {".cgw", ".cgz"};
+
+/* A material configuration. Its pieces are placed in slots: the white king, the black king, then
+   the other white and black pieces in QRBNP order. Tables are stored with the stronger side as
+   white, the other colour orientation is probed by flipping the board */
+struct Table
+{
+    std::string name;
+    std::vector<int> pieces;
+    int men;
+    bool hasPawns;
+    // Material signature, and the signature with the colours swapped
+    uint64_t key;
+    uint64_t swappedKey;
+    // Ranges of slots holding identical pieces, whose squares are kept sorted
+    std::vector<std::pair<int, int>> groups;
+    uint64_t size;
+    std::array<MappedFile, 2> files;
+};
+
+std::vector<std::unique_ptr<Table>> tables;
+std::unordered_map<uint64_t, Table*> tableByKey;
+
+// A set of pieces with their squares, not necessarily matching any table's slot order
+struct Pieces
+{
+    int count = 0;
+    std::array<int, MAX_MEN> piece;
+    std::array<int, MAX_MEN> sq;
+    int side = 0;
+};
+
+/* Indexing */
+
+// Without pawns the white king is brought into the a8-d8-d5 triangle by the board's 8
+// symmetries, with pawns only the file mirror applies and it stays on the a-d files
+const std::array<int, 64> pawnlessKingIndex = [] {
+    std::array<int, 64> index;
+    index.fill(-1);
+    for (int sq = 0, count = 0; sq < 64; sq++) {
+        if (ROW(sq) <= 3 && COL(sq) <= 3 && ROW(sq) <= COL(sq))
+            index[sq] = count++;
+    }
+    return index;
+}();
+
+const std::array<int, 64> pawnKingIndex = [] {
+    std::array<int, 64> index;
+    index.fill(-1);
+    for (int sq = 0, count = 0; sq < 64; sq++) {
+        if (COL(sq) <= 3)
+            index[sq] = count++;
+    }
+    return index;
+}();
+
+std::array<int, 32> kingSquares(const bool hasPawns) {
+    std::array<int, 32> squares{};
+    const std::array<int, 64>& index = hasPawns ? pawnKingIndex : pawnlessKingIndex;
+    for (int sq = 0; sq < 64; sq++) {
+        if (index[sq] >= 0)
+            squares[index[sq]] = sq;
+    }
+    return squares;
+}
+
+const std::array<int, 32> pawnlessKingSquares = kingSquares(false);
+const std::array<int, 32> pawnKingSquares = kingSquares(true);
+
+inline int transpose(const int sq) { return SQ(COL(sq), ROW(sq)); }
+inline bool isWhite(const int piece) { return piece < 6; }
+inline int swapColor(const int piece) { return isWhite(piece) ? piece + 6 : piece - 6; }
+
+using Squares = std::array<int, MAX_MEN>;
+
+void sortGroups(const Table& table, Squares& sq) {
+    for (auto [begin, end] : table.groups)
+        std::sort(sq.begin() + begin, sq.begin() + end);
+}
+
+/* Picks the one representative of the position's symmetry class the table stores */
+void canonicalize(const Table& table, Squares& sq) {
+    auto apply = [&](auto transform) {
+        for (int i = 0; i < table.men; i++)
+            sq[i] = transform(sq[i]);
+    };
+    if (COL(sq[0]) > 3)
+        apply([](int s) { return s ^ 7; });
+    if (!table.hasPawns) {
+        if (ROW(sq[0]) > 3)
+            apply([](int s) { return s ^ 56; });
+        if (ROW(sq[0]) > COL(sq[0]))
+            apply(transpose);
+    }
+    sortGroups(table, sq);
+
+    // A king on the diagonal is left in place by the transposition, so both versions are in
+    // the triangle and the smaller one is taken
+    if (!table.hasPawns && ROW(sq[0]) == COL(sq[0])) {
+        Squares transposed = sq;
+        for (int i = 0; i < table.men; i++)
+            transposed[i] = transpose(transposed[i]);
+        sortGroups(table, transposed);
+        if (std::lexicographical_compare(transposed.begin(), transposed.begin() + table.men,
+                                         sq.begin(), sq.begin() + table.men))
+            sq = transposed;
+    }
+}
+
+// Expects canonical squares
+uint64_t encode(const Table& table, const Squares& sq, const int side) {
+    uint64_t index = (table.hasPawns ? pawnKingIndex : pawnlessKingIndex)[sq[0]];
+    for (int i = 1; i < table.men; i++)
+        index = index * 64 + sq[i];
+    // The side to move is the top bit, so each side's half stays contiguous and runs stay long
+    return side * (table.size / 2) + index;
+}
+
+void decode(const Table& table, uint64_t index, Squares& sq, int& side) {
+    side = index >= table.size / 2;
+    index -= side * (table.size / 2);
+    for (int i = table.men - 1; i > 0; i--) {
+        sq[i] = index & 63;
+        index >>= 6;
+    }
+    sq[0] = (table.hasPawns ? pawnKingSquares : pawnlessKingSquares)[index];
+}
+
+uint64_t canonicalIndex(const Table& table, Squares sq, const int side) {
+    canonicalize(table, sq);
+    return encode(table, sq, side);
+}
+
+/* Material */
+
+const std::string pieceOrder = "QRBNP";
+const std::array<int, 6> pieceWorth = {1, 3, 3, 5, 9, 0};
+
+uint64_t signature(const Pieces& pieces) {
+    uint64_t key = 0;
+    for (int i = 0; i < pieces.count; i++)
+        key += 1ULL << (4 * pieces.piece[i]);
+    return key;
+}
+
+uint64_t swapSignature(const uint64_t key) {
+    return (key >> 24) | ((key & 0xFFFFFF) << 24);
+}
+
+// Parses names like "KRPvKR"
+std::unique_ptr<Table> makeTable(const std::string& name) {
+    size_t split = name.find('v');
+    if (split == std::string::npos || name.size() > MAX_MEN + 1 || name[0] != 'K' ||
+        name[split + 1] != 'K')
+        return nullptr;
+    auto table = std::make_unique<Table>();
+    table->name = name;
+    table->pieces = {(int)Piece::K, (int)Piece::k};
+    for (int color = 0; color < 2; color++) {
+        std::string side = color == 0 ? name.substr(1, split - 1) : name.substr(split + 2);
+        for (char c : side) {
+            size_t type = pieceStr.find(c);
+            if (type == std::string::npos || type >= 5)
+                return nullptr;
+            table->pieces.push_back(type + color * 6);
+        }
+    }
+    table->men = table->pieces.size();
+    table->hasPawns = false;
+    Pieces pieces;
+    pieces.count = table->men;
+    for (int i = 0; i < table->men; i++) {
+        pieces.piece[i] = table->pieces[i];
+        table->hasPawns |= COLORLESS(table->pieces[i]) == (int)PieceTypes::PAWN;
+    }
+    table->key = signature(pieces);
+    table->swappedKey = swapSignature(table->key);
+    for (int i = 2; i < table->men;) {
+        int end = i;
+        while (end < table->men && table->pieces[end] == table->pieces[i])
+            end++;
+        if (end - i > 1)
+            table->groups.push_back({i, end});
+        i = end;
+    }
+    table->size = (table->hasPawns ? 32 : 10) * 2;
+    for (int i = 1; i < table->men; i++)
+        table->size *= 64;
+    return table;
+}
+
+void registerTable(std::unique_ptr<Table> table) {
+    tableByKey[table->key] = table.get();
+    tableByKey[table->swappedKey] = table.get();
+    maxMen = std::max(maxMen, table->men);
+    tables.push_back(std::move(table));
+}
+
+bool openFiles(Table& table, const std::string& dir) {
+    for (int kind = 0; kind < 2; kind++) {
+        std::string path = dir + "/" + table.name + extensions[kind];
+        MappedFile& file = table.files[kind];
+        FileHeader header;
+        if (!file.open(path) || file.size < sizeof(FileHeader)) {
+            std::cerr << "Failed to open tablebase file '" << path << "'\n";
+            return false;
+        }
+        std::memcpy(&header, file.data, sizeof(FileHeader));
+        if (std::memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION ||
+            header.kind != (uint32_t)kind || header.blockSize != BLOCK_SIZE ||
+            header.entries != table.size ||
+            file.size < sizeof(FileHeader) + header.blockCount * sizeof(uint64_t)) {
+            std::cerr << "'" << path << "' isn't a compatible tablebase file\n";
+            file.close();
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Loads every table in the directory, replacing the loaded ones. Returns how many were found */
+int init(const std::string& dir) {
+    tableByKey.clear();
+    tables.clear();
+    maxMen = 0;
+    std::error_code error;
+    // The default directory is usually absent, which isn't worth a complaint
+    if (dir.empty() || !std::filesystem::exists(dir, error))
+        return 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, error)) {
+        if (entry.path().extension() != extensions[WDL_FILE])
+            continue;
+        std::unique_ptr<Table> table = makeTable(entry.path().stem().string());
+        if (table && openFiles(*table, dir))
+            registerTable(std::move(table));
+    }
+    if (error)
+        std::cerr << "Failed to read tablebase directory '" << dir << "'\n";
+    return tables.size();
+}
+
+/* Probing */
+
+uint8_t readEntry(const MappedFile& file, const uint64_t index) {
+    FileHeader header;
+    std::memcpy(&header, file.data, sizeof(FileHeader));
+    uint64_t offset;
+    std::memcpy(&offset, file.data + sizeof(FileHeader) + (index / BLOCK_SIZE) * sizeof(uint64_t),
+                sizeof(uint64_t));
+    const uint8_t* run = reinterpret_cast<const uint8_t*>(
+        file.data + sizeof(FileHeader) + header.blockCount * sizeof(uint64_t) + offset);
+    uint32_t remaining = index % BLOCK_SIZE;
+    while (remaining > run[1]) {
+        remaining -= run[1] + 1;
+        run += 2;
+    }
+    return run[0];
+}
+
+/* Looks the pieces up in their table, in whichever colour orientation it's stored */
+bool probeEntry(const Pieces& pieces, const Kind kind, uint8_t& value) {
+    uint64_t key = signature(pieces);
+    auto it = tableByKey.find(key);
+    if (it == tableByKey.end())
+        return false;
+    const Table& table = *it->second;
+    bool swapped = key != table.key;
+
+    Squares sq;
+    std::array<bool, MAX_MEN> used{};
+    for (int slot = 0; slot < table.men; slot++) {
+        for (int i = 0; i < pieces.count; i++) {
+            int piece = swapped ? swapColor(pieces.piece[i]) : pieces.piece[i];
+            if (!used[i] && piece == table.pieces[slot]) {
+                sq[slot] = swapped ? FLIP(pieces.sq[i]) : pieces.sq[i];
+                used[i] = true;
+                break;
+            }
+        }
+    }
+    const MappedFile& file = table.files[kind];
+    if (!file.data)
+        return false;
+    value = readEntry(file, canonicalIndex(table, sq, swapped ? pieces.side ^ 1 : pieces.side));
+    return true;
+}
+
+bool toPieces(const Board& board, Pieces& pieces) {
+    pieces.count = 0;
+    pieces.side = (int)board.state.side;
+    for (int piece = 0; piece < 12; piece++) {
+        uint64_t bitboard = board.pos.pieces[piece];
+        while (bitboard) {
+            if (pieces.count == MAX_MEN)
+                return false;
+            int sq = Bitboard::lsbIndex(bitboard);
+            pieces.piece[pieces.count] = piece;
+            pieces.sq[pieces.count++] = sq;
+            popBit(bitboard, sq);
+        }
+    }
+    return true;
+}
+
+bool probeWDL(const Board& board, WDL& wdl) {
+    Pieces pieces;
+    if (board.state.castling || !toPieces(board, pieces) || pieces.count > maxMen)
+        return false;
+    // Bare kings need no table
+    if (pieces.count == 2) {
+        wdl = WDL::Draw;
+        return true;
+    }
+    uint8_t value;
+    if (!probeEntry(pieces, WDL_FILE, value))
+        return false;
+    wdl = (WDL)(value - 1);
+    return true;
+}
+
+bool probeDTZ(const Board& board, WDL& wdl, int& dtz) {
+    if (!probeWDL(board, wdl))
+        return false;
+    dtz = 0;
+    if (wdl == WDL::Draw)
+        return true;
+    Pieces pieces;
+    toPieces(board, pieces);
+    uint8_t value;
+    if (!probeEntry(pieces, DTZ_FILE, value))
+        return false;
+    dtz = value;
+    return true;
+}
+
+/* Picks the root move that keeps the best result: the fastest zeroing win, any draw, or the
+   slowest loss */
+bool probeRoot(const Board& board, int& move, WDL& wdl, int& dtz) {
+    int rootDtz;
+    if (!probeDTZ(board, wdl, rootDtz))
+        return false;
+
+    Move::MoveList moveList;
+    Move::generate(moveList, board);
+    int bestRank = -1000000;
+    move = 0;
+    for (int i = 0; i < moveList.count; i++) {
+        Board child = board;
+        if (!Move::make(&child, moveList.list[i], Move::MoveType::allMoves))
+            continue;
+        bool zeroing = Move::isCapture(moveList.list[i]) ||
+                       COLORLESS(Move::getPiece(moveList.list[i])) == (int)PieceTypes::PAWN;
+        WDL childWdl;
+        int childDtz = 0;
+        if (zeroing ? !probeWDL(child, childWdl) : !probeDTZ(child, childWdl, childDtz))
+            return false;
+        int moveDtz = zeroing ? (childWdl != WDL::Draw) : childDtz + 1;
+        int rank = childWdl == WDL::Loss ? 1000 - moveDtz
+                 : childWdl == WDL::Win  ? -1000 + moveDtz
+                                         : 0;
+        if (rank > bestRank) {
+            bestRank = rank;
+            move = moveList.list[i];
+            wdl = (WDL)(-(int)childWdl);
+            dtz = wdl == WDL::Draw ? 0 : moveDtz;
+        }
+    }
+    return move != 0;
+}
+
+/* Generation */
+
+uint64_t attacks(const int piece, const int sq, const uint64_t occupancy) {
+    switch ((PieceTypes)COLORLESS(piece)) {
+    case PieceTypes::PAWN:
+        return Attack::pawnAttacks[isWhite(piece) ? 0 : 1][sq];
+    case PieceTypes::KNIGHT:
+        return Attack::knightAttacks[sq];
+    case PieceTypes::BISHOP:
+        return Magics::getBishopAttack(sq, occupancy);
+    case PieceTypes::ROOK:
+        return Magics::getRookAttack(sq, occupancy);
+    case PieceTypes::QUEEN:
+        return Magics::getQueenAttack(sq, occupancy);
+    default:
+        return Attack::kingAttacks[sq];
+    }
+}
+
+enum Result : uint8_t { UNKNOWN, WIN, LOSS, DRAW, INVALID };
+
+/* Retrograde analysis of one table. Every position is first scored from its exits, the moves
+   leaving the table, then results spread backwards from the decided positions one ply at a
+   time: a position with a lost successor is won, and one whose successors are all won is lost.
+   Whatever stays undecided is a draw. Distances count plies to the next exit, which is what
+   makes them DTZ values */
+struct Generator
+{
+    const Table& table;
+    // In the second pass over a table with pawns, pawn moves are exits too and get their result
+    // from the first pass
+    const std::vector<uint8_t>* pawnResults;
+    int threads;
+    std::vector<std::atomic<uint8_t>> results;
+    // Undecided successors left, plus one if an exit draws
+    std::vector<std::atomic<uint8_t>> successors;
+    std::vector<uint16_t> distances;
+    // layers[n] holds the positions decided at distance n
+    std::vector<std::vector<uint64_t>> layers;
+    std::atomic<bool> missingTable = false;
+
+    Generator(const Table& table, const std::vector<uint8_t>* pawnResults)
+        : table(table), pawnResults(pawnResults), threads(Parallel::threadCount()),
+          results(table.size), successors(table.size), distances(table.size) {}
+
+    uint64_t occupancy(const Squares& sq) const {
+        uint64_t occupied = 0;
+        for (int i = 0; i < table.men; i++)
+            occupied |= 1ULL << sq[i];
+        return occupied;
+    }
+
+    bool isAttacked(const Squares& sq, const uint64_t occupied, const int target,
+                    const int byWhite, const int skip = -1) const {
+        for (int i = 0; i < table.men; i++) {
+            if (i != skip && isWhite(table.pieces[i]) == byWhite &&
+                getBit(attacks(table.pieces[i], sq[i], occupied), target))
+                return true;
+        }
+        return false;
+    }
+
+    bool isValid(const Squares& sq, const int side) const {
+        uint64_t occupied = occupancy(sq);
+        if (Bitboard::countBits(occupied) != table.men)
+            return false;
+        for (int i = 0; i < table.men; i++) {
+            if (COLORLESS(table.pieces[i]) == (int)PieceTypes::PAWN &&
+                (ROW(sq[i]) == 0 || ROW(sq[i]) == 7))
+                return false;
+        }
+        // The side that just moved can't be in check
+        if (isAttacked(sq, occupied, sq[side == 0 ? 1 : 0], side == 0))
+            return false;
+        Squares canonical = sq;
+        canonicalize(table, canonical);
+        return std::equal(sq.begin(), sq.begin() + table.men, canonical.begin());
+    }
+
+    // Result of a position outside this table, from its side to move's point of view
+    bool probeExit(const Squares& sq, const int captured, const int mover, const int promoted,
+                   const int side, int& wdl) const {
+        Pieces pieces;
+        pieces.side = side;
+        for (int i = 0; i < table.men; i++) {
+            if (i == captured)
+                continue;
+            pieces.piece[pieces.count] = i == mover ? promoted : table.pieces[i];
+            pieces.sq[pieces.count++] = sq[i];
+        }
+        if (pieces.count == 2) {
+            wdl = 0;
+            return true;
+        }
+        uint8_t value;
+        if (!probeEntry(pieces, WDL_FILE, value))
+            return false;
+        wdl = value - 1;
+        return true;
+    }
+
+    void decide(const uint64_t index, const Result result, const int distance,
+                std::vector<uint64_t>& decided) {
+        distances[index] = distance;
+        results[index].store(result, std::memory_order_relaxed);
+        decided.push_back(index);
+    }
+
+    void initPosition(const uint64_t index, std::vector<std::vector<uint64_t>>& decided) {
+        Squares sq;
+        int side;
+        decode(table, index, sq, side);
+        if (!isValid(sq, side)) {
+            results[index].store(INVALID, std::memory_order_relaxed);
+            return;
+        }
+        uint64_t occupied = occupancy(sq), own = 0;
+        for (int i = 0; i < table.men; i++) {
+            if (isWhite(table.pieces[i]) == (side == 0))
+                own |= 1ULL << sq[i];
+        }
+
+        bool hasMove = false;
+        int bestExit = -2;
+        std::array<uint64_t, 256> children;
+        int childCount = 0;
+        for (int i = 0; i < table.men; i++) {
+            int piece = table.pieces[i];
+            if (isWhite(piece) != (side == 0))
+                continue;
+            bool isPawn = COLORLESS(piece) == (int)PieceTypes::PAWN;
+            uint64_t targets = attacks(piece, sq[i], occupied);
+            if (isPawn) {
+                targets &= occupied;
+                int push = sq[i] + (side == 0 ? -8 : 8);
+                if (!getBit(occupied, push)) {
+                    setBit(targets, push);
+                    int startRow = side == 0 ? 6 : 1;
+                    int doublePush = push + (side == 0 ? -8 : 8);
+                    if (ROW(sq[i]) == startRow && !getBit(occupied, doublePush))
+                        setBit(targets, doublePush);
+                }
+            }
+            targets &= ~own;
+
+            while (targets) {
+                int target = Bitboard::lsbIndex(targets);
+                popBit(targets, target);
+                int captured = -1;
+                for (int j = 0; j < table.men; j++) {
+                    if (sq[j] == target)
+                        captured = j;
+                }
+                Squares next = sq;
+                next[i] = target;
+                uint64_t nextOccupied = (occupied ^ (1ULL << sq[i])) | (1ULL << target);
+                if (isAttacked(next, nextOccupied, next[side == 0 ? 0 : 1], side != 0, captured))
+                    continue;
+                hasMove = true;
+
+                bool promotion = isPawn && (ROW(target) == 0 || ROW(target) == 7);
+                if (captured >= 0 || promotion) {
+                    int first = promotion ? (int)PieceTypes::KNIGHT : COLORLESS(piece);
+                    int last = promotion ? (int)PieceTypes::QUEEN : COLORLESS(piece);
+                    for (int type = first; type <= last; type++) {
+                        int wdl;
+                        if (!probeExit(next, captured, i, type + (side == 0 ? 0 : 6), side ^ 1,
+                                       wdl)) {
+                            missingTable = true;
+                            continue;
+                        }
+                        bestExit = std::max(bestExit, -wdl);
+                    }
+                } else if (isPawn && pawnResults) {
+                    int wdl = (*pawnResults)[canonicalIndex(table, next, side ^ 1)] - 1;
+                    bestExit = std::max(bestExit, -wdl);
+                } else {
+                    children[childCount++] = canonicalIndex(table, next, side ^ 1);
+                }
+            }
+        }
+
+        if (bestExit == 1) {
+            decide(index, WIN, 1, decided[1]);
+        } else if (!hasMove) {
+            bool inCheck = isAttacked(sq, occupied, sq[side == 0 ? 0 : 1], side != 0);
+            if (inCheck)
+                decide(index, LOSS, 0, decided[0]);
+            else
+                results[index].store(DRAW, std::memory_order_relaxed);
+        } else {
+            std::sort(children.begin(), children.begin() + childCount);
+            int count = std::unique(children.begin(), children.begin() + childCount) -
+                        children.begin() + (bestExit == 0);
+            if (count == 0) {
+                decide(index, LOSS, 1, decided[1]);
+            } else {
+                successors[index].store(count, std::memory_order_relaxed);
+                results[index].store(UNKNOWN, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Positions one move before the given one, by non-capturing moves that stay in the table
+    int predecessors(const Squares& sq, const int side, std::array<uint64_t, 256>& list) const {
+        uint64_t occupied = occupancy(sq);
+        int mover = side ^ 1, count = 0;
+        for (int i = 0; i < table.men; i++) {
+            int piece = table.pieces[i];
+            if (isWhite(piece) != (mover == 0))
+                continue;
+            uint64_t origins = 0;
+            if (COLORLESS(piece) == (int)PieceTypes::PAWN) {
+                if (pawnResults)
+                    continue;
+                int back = mover == 0 ? 8 : -8;
+                int from = sq[i] + back;
+                int startRow = mover == 0 ? 6 : 1;
+                if (ROW(from) != (mover == 0 ? 7 : 0) && !getBit(occupied, from)) {
+                    setBit(origins, from);
+                    if (ROW(from + back) == startRow && !getBit(occupied, from + back))
+                        setBit(origins, from + back);
+                }
+            } else {
+                origins = attacks(piece, sq[i], occupied) & ~occupied;
+            }
+            while (origins) {
+                int from = Bitboard::lsbIndex(origins);
+                popBit(origins, from);
+                Squares previous = sq;
+                previous[i] = from;
+                list[count++] = canonicalIndex(table, previous, mover);
+            }
+        }
+        std::sort(list.begin(), list.begin() + count);
+        return std::unique(list.begin(), list.begin() + count) - list.begin();
+    }
+
+    void propagate(const uint64_t index, const int distance, std::vector<uint64_t>& decided) {
+        Squares sq;
+        int side;
+        decode(table, index, sq, side);
+        bool lost = results[index].load(std::memory_order_relaxed) == LOSS;
+        std::array<uint64_t, 256> list;
+        int count = predecessors(sq, side, list);
+        for (int i = 0; i < count; i++) {
+            uint64_t previous = list[i];
+            uint8_t expected = UNKNOWN;
+            if (results[previous].load(std::memory_order_relaxed) != UNKNOWN)
+                continue;
+            if (lost) {
+                if (results[previous].compare_exchange_strong(expected, WIN)) {
+                    distances[previous] = distance + 1;
+                    decided.push_back(previous);
+                }
+            } else if (successors[previous].fetch_sub(1) == 1) {
+                decide(previous, LOSS, distance + 1, decided);
+            }
+        }
+    }
+
+    bool run() {
+        layers.assign(2, {});
+        std::vector<std::vector<std::vector<uint64_t>>> local(
+            threads, std::vector<std::vector<uint64_t>>(2));
+        Parallel::parallelFor(table.size, threads, [&](size_t begin, size_t end, int t) {
+            for (size_t index = begin; index < end; index++)
+                initPosition(index, local[t]);
+        });
+        if (missingTable)
+            return false;
+        for (auto& decided : local) {
+            for (int n = 0; n < 2; n++)
+                layers[n].insert(layers[n].end(), decided[n].begin(), decided[n].end());
+        }
+
+        for (size_t n = 0; n < layers.size(); n++) {
+            std::vector<std::vector<uint64_t>> next(threads);
+            const std::vector<uint64_t>& layer = layers[n];
+            Parallel::parallelFor(layer.size(), threads, [&](size_t begin, size_t end, int t) {
+                for (size_t i = begin; i < end; i++)
+                    propagate(layer[i], n, next[t]);
+            });
+            std::vector<uint64_t> merged = n + 1 < layers.size() ? layers[n + 1]
+                                                                 : std::vector<uint64_t>();
+            for (auto& decided : next)
+                merged.insert(merged.end(), decided.begin(), decided.end());
+            if (merged.empty())
+                break;
+            if (n + 1 < layers.size())
+                layers[n + 1] = std::move(merged);
+            else
+                layers.push_back(std::move(merged));
+        }
+
+        for (auto& result : results) {
+            if (result.load(std::memory_order_relaxed) == UNKNOWN)
+                result.store(DRAW, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // 0, 1 or 2 for a loss, draw or win, INVALID for positions that can't occur
+    uint8_t wdl(const uint64_t index) const {
+        switch (results[index].load(std::memory_order_relaxed)) {
+        case WIN:
+            return 2;
+        case LOSS:
+            return 0;
+        case DRAW:
+            return 1;
+        default:
+            return INVALID;
+        }
+    }
+};
+
+/* Run-length codes the entries block by block. Positions that can't occur, marked INVALID in
+   'wdl', repeat the previous value */
+bool writeFile(const std::string& path, const Kind kind, const std::vector<uint8_t>& entries,
+               const std::vector<uint8_t>& wdl) {
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.kind = kind;
+    header.blockSize = BLOCK_SIZE;
+    header.entries = entries.size();
+    header.blockCount = (entries.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    std::vector<uint64_t> offsets(header.blockCount);
+    std::vector<uint8_t> data;
+    uint8_t previous = 0;
+    for (uint64_t block = 0; block < header.blockCount; block++) {
+        offsets[block] = data.size();
+        uint64_t end = std::min<uint64_t>(entries.size(), (block + 1) * BLOCK_SIZE);
+        for (uint64_t i = block * BLOCK_SIZE; i < end; i++) {
+            uint8_t value = wdl[i] == INVALID ? previous : entries[i];
+            previous = value;
+            // Extend the current run unless it's full or belongs to the previous block
+            if (i > block * BLOCK_SIZE && data[data.size() - 2] == value && data.back() < 255)
+                data.back()++;
+            else
+                data.insert(data.end(), {value, 0});
+        }
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return (bool)file;
+}
+
+/* Every configuration with 3 to 'men' pieces in its stored orientation, in an order where each
+   table only depends on earlier ones: captures lose a piece, promotions lose a pawn */
+std::vector<std::string> tableNames(const int men) {
+    std::vector<std::string> sides = {""};
+    for (int size = 0; size < men - 2; size++) {
+        std::vector<std::string> longer;
+        for (const std::string& side : sides) {
+            if ((int)side.size() != size)
+                continue;
+            size_t first = side.empty() ? 0 : pieceOrder.find(side.back());
+            for (size_t type = first; type < pieceOrder.size(); type++)
+                longer.push_back(side + pieceOrder[type]);
+        }
+        sides.insert(sides.end(), longer.begin(), longer.end());
+    }
+
+    auto worth = [](const std::string& side) {
+        int total = 0;
+        for (char c : side)
+            total += pieceWorth[pieceStr.find(c)];
+        return total;
+    };
+    auto pawns = [](const std::string& name) { return std::count(name.begin(), name.end(), 'P'); };
+
+    std::vector<std::string> names;
+    for (const std::string& white : sides) {
+        for (const std::string& black : sides) {
+            int total = 2 + white.size() + black.size();
+            if (total < 3 || total > men)
+                continue;
+            // The stronger side is stored as white
+            if (worth(white) < worth(black) || (worth(white) == worth(black) && white < black))
+                continue;
+            names.push_back("K" + white + "vK" + black);
+        }
+    }
+    std::stable_sort(names.begin(), names.end(), [&](const std::string& a, const std::string& b) {
+        if (a.size() != b.size())
+            return a.size() < b.size();
+        return pawns(a) < pawns(b);
+    });
+    return names;
+}
+
+bool generateTable(Table& table, const std::string& dir) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> wdl(table.size), dtz(table.size);
+    std::vector<uint16_t> distances;
+    uint64_t mismatches = 0;
+    {
+        Generator generator(table, nullptr);
+        if (!generator.run()) {
+            std::cerr << table.name << ": a smaller table is missing\n";
+            return false;
+        }
+        for (uint64_t i = 0; i < table.size; i++)
+            wdl[i] = generator.wdl(i);
+        distances = std::move(generator.distances);
+    }
+    // With pawns the first pass only settles the results, as its distances run through pawn
+    // moves. A second pass treats pawn moves as exits to count the plies to the next zeroing move
+    if (table.hasPawns) {
+        Generator generator(table, &wdl);
+        generator.run();
+        for (uint64_t i = 0; i < table.size; i++)
+            mismatches += generator.wdl(i) != wdl[i];
+        distances = std::move(generator.distances);
+    }
+    // Both passes must reach the same results
+    if (mismatches)
+        std::cerr << table.name << ": " << mismatches << " positions disagree between passes\n";
+
+    uint64_t counts[3] = {0, 0, 0};
+    int longest = 0;
+    for (uint64_t i = 0; i < table.size; i++) {
+        if (wdl[i] == INVALID)
+            continue;
+        counts[wdl[i]]++;
+        int distance = wdl[i] == 1 ? 0 : distances[i];
+        longest = std::max(longest, distance);
+        dtz[i] = std::min(distance, 255);
+    }
+
+    for (int kind = 0; kind < 2; kind++) {
+        std::string path = dir + "/" + table.name + extensions[kind];
+        if (!writeFile(path, (Kind)kind, kind == WDL_FILE ? wdl : dtz, wdl)) {
+            std::cerr << "Failed to write '" << path << "'\n";
+            return false;
+        }
+    }
+
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << table.name << ": " << counts[2] << " wins, " << counts[1] << " draws, "
+              << counts[0] << " losses, longest DTZ " << longest << ", " << seconds << "s"
+              << std::endl;
+    return mismatches == 0;
+}
+
+/* Generates every missing table with up to 'men' pieces into the directory, then loads them */
+bool generate(const std::string& dir, const int men) {
+    if (men < 3 || men > MAX_MEN) {
+        std::cerr << "Tables can be generated for 3 to " << MAX_MEN << " pieces\n";
+        return false;
+    }
+    std::filesystem::create_directories(dir);
+    init(dir);
+    for (const std::string& name : tableNames(men)) {
+        std::unique_ptr<Table> table = makeTable(name);
+        if (tableByKey.count(table->key))
+            continue;
+        if (!generateTable(*table, dir) || !openFiles(*table, dir))
+            return false;
+        registerTable(std::move(table));
+    }
+    return true;
+}
+
+} // namespace Tablebase
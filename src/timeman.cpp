@@ -0,0 +1,61 @@
+#include "timeman.hpp"
+
+#include <algorithm>
+
+#include "options.hpp"
+#include "search.hpp"
+
+namespace TimeMan {
+
+// Number of moves assumed to be left in the game under sudden death time controls
+constexpr int DEFAULT_MOVES_TO_GO = 40;
+
+/* Derives the soft and hard limits from the clock of the side to move */
+void Manager::init(const Search::Limits& limits, const PieceColor side, const long long start) {
+    startTime = start;
+    enabled = false;
+    fixedTime = false;
+
+    long long overhead = Options::get("MoveOverhead");
+    if (limits.movetime) {
+        softLimit = hardLimit = std::max(1LL, limits.movetime - overhead);
+        enabled = fixedTime = true;
+        return;
+    }
+
+    long long time = side == PieceColor::LIGHT ? limits.wtime : limits.btime;
+    long long increment = side == PieceColor::LIGHT ? limits.winc : limits.binc;
+    if (limits.infinite || time <= 0)
+        return;
+
+    long long available = std::max(1LL, time - overhead);
+    int movesToGo = limits.movestogo > 0 ? std::min(limits.movestogo, 50) : DEFAULT_MOVES_TO_GO;
+
+    // Spend an equal share of the remaining time plus most of the increment on average, but
+    // allow a single move to take several times its share when the search is unstable
+    softLimit = available / movesToGo + increment * 3 / 4;
+    hardLimit = std::min(available * 3 / 4, softLimit * 5);
+    // The last move before the time control can use almost everything
+    if (limits.movestogo == 1)
+        hardLimit = available * 9 / 10;
+    softLimit = std::min(softLimit, hardLimit);
+    enabled = true;
+}
+
+long long Manager::elapsed() const { return Search::now() - startTime; }
+
+bool Manager::hardLimitReached() const { return enabled && elapsed() >= hardLimit; }
+
+/* Decides after each iteration whether to start another one. A best move that has been stable
+   for several iterations ends the search early, while a falling score extends it, since that's
+   when extra time is most likely to change the decision */
+bool Manager::stopIteration(const int stableIterations, const int scoreDrop) const {
+    // A fixed move time is meant to be used up
+    if (!enabled || fixedTime)
+        return false;
+    double stability = 1.6 - 0.15 * std::min(stableIterations, 6);
+    double falling = 1.0 + std::clamp(scoreDrop, 0, 100) / 100.0;
+    return elapsed() >= softLimit * stability * falling;
+}
+
+} // namespace TimeMan
@@ -0,0 +1,184 @@
+#include "tt.hpp"
+#include "search.hpp"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace TT {
+
+Bucket* table = nullptr;
+size_t bucketCount = 0;
+uint8_t age = 0;
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/* Allocates the table aligned to a huge page and asks the kernel to back it with huge pages,
+   which cuts TLB misses on random probes. Falls back to cache line alignment elsewhere */
+void* allocate(size_t size) {
+#if defined(__linux__)
+    size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void* mem = std::aligned_alloc(HUGE_PAGE_SIZE, size);
+    if (mem)
+        madvise(mem, size, MADV_HUGEPAGE);
+    return mem;
+#elif defined(_WIN32)
+    return _aligned_malloc(size, alignof(Bucket));
+#else
+    return std::aligned_alloc(alignof(Bucket), size);
+#endif
+}
+
+void deallocate(void* mem) {
+#if defined(_WIN32)
+    _aligned_free(mem);
+#else
+    std::free(mem);
+#endif
+}
+
+/* (Re)allocates the table to the given size in megabytes. The table is only allocated here, so
+   searches never allocate */
+void resize(const size_t mb) {
+    if (table)
+        deallocate(table);
+    bucketCount = (mb * 1024 * 1024) / sizeof(Bucket);
+    table = static_cast<Bucket*>(allocate(bucketCount * sizeof(Bucket)));
+    if (!table) {
+        std::cerr << "Failed to allocate " << mb << "MB for the transposition table\n";
+        std::exit(1);
+    }
+    for (size_t i = 0; i < bucketCount; i++)
+        new (&table[i]) Bucket();
+    clear();
+}
+
+void clear() {
+    for (size_t i = 0; i < bucketCount; i++) {
+        for (Slot& slot : table[i].slots) {
+            slot.key.store(0, std::memory_order_relaxed);
+            slot.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    age = 0;
+}
+
+/* Entries from older searches become preferred victims for replacement */
+void newSearch() { age = (age + 1) & 0x3F; }
+
+inline Bucket& bucketOf(const uint64_t key) {
+#if defined(__SIZEOF_INT128__)
+    // Maps the key onto [0, bucketCount) without a division
+    __extension__ using uint128 = unsigned __int128;
+    return table[(uint64_t)(((uint128)key * bucketCount) >> 64)];
+#else
+    return table[key % bucketCount];
+#endif
+}
+
+inline uint64_t pack(const int move, const int score, const int depth, const Bound bound) {
+    return (uint64_t)(move & 0xFFFFFF) | ((uint64_t)(score & 0xFFFFFF) << 24) |
+           ((uint64_t)(uint8_t)depth << 48) | ((uint64_t)bound << 56) | ((uint64_t)age << 58);
+}
+
+inline int dataAge(const uint64_t data) { return (data >> 58) & 0x3F; }
+inline int dataDepth(const uint64_t data) { return (int)(int8_t)((data >> 48) & 0xFF); }
+// Sign extends the 24 bit field
+inline int dataScore(const uint64_t data) {
+    return (int)((uint32_t)((data >> 24) & 0xFFFFFF) << 8) >> 8;
+}
+
+bool probe(const uint64_t key, Entry& entry) {
+    for (Slot& slot : bucketOf(key).slots) {
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        if ((slot.key.load(std::memory_order_relaxed) ^ data) != key || data == 0)
+            continue;
+        entry.move = data & 0xFFFFFF;
+        entry.score = dataScore(data);
+        entry.depth = dataDepth(data);
+        entry.bound = (Bound)((data >> 56) & 0x3);
+        return true;
+    }
+    return false;
+}
+
+void store(const uint64_t key, const int move, const int score, const int depth, const Bound bound) {
+    Bucket& bucket = bucketOf(key);
+    Slot* replace = &bucket.slots[0];
+    int newMove = move;
+    int worstWorth = INT32_MAX;
+    for (Slot& slot : bucket.slots) {
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        // Always overwrite the same position or an empty slot
+        if (data == 0 || (slot.key.load(std::memory_order_relaxed) ^ data) == key) {
+            // Keep the old move if the new result doesn't come with one
+            if (newMove == 0)
+                newMove = data & 0xFFFFFF;
+            replace = &slot;
+            break;
+        }
+        // Otherwise replace the shallowest entry, treating every search of age as 8 plies
+        int worth = dataDepth(data) - 8 * ((age - dataAge(data)) & 0x3F);
+        if (worth < worstWorth) {
+            worstWorth = worth;
+            replace = &slot;
+        }
+    }
+    uint64_t data = pack(newMove, score, depth, bound);
+    replace->key.store(key ^ data, std::memory_order_relaxed);
+    replace->data.store(data, std::memory_order_relaxed);
+}
+
+void prefetch(const uint64_t key) {
+#if defined(__GNUC__)
+    __builtin_prefetch(&bucketOf(key));
+#endif
+}
+
+/* Returns how full the table is in permill, sampled over the first thousand buckets'
+   entries written by the current search */
+int hashfull() {
+    int used = 0;
+    size_t samples = bucketCount < 1000 ? bucketCount : 1000;
+    for (size_t i = 0; i < samples; i++) {
+        for (Slot& slot : table[i].slots) {
+            uint64_t data = slot.data.load(std::memory_order_relaxed);
+            if (data != 0 && dataAge(data) == age)
+                used++;
+        }
+    }
+    return samples ? (int)(used * 1000 / (samples * BUCKET_SIZE)) : 0;
+}
+
+/* Stores and probes entries at the extremes of every field, including mate and tablebase
+   scores, which don't fit in 16 bits */
+void test() {
+    const int scores[] = {0, 1, -1, 32767, -32768, Search::MATE_VALUE - 1,
+                          -(Search::MATE_VALUE - 1), Search::TB_WIN_SCORE, -Search::TB_WIN_SCORE};
+    const int depths[] = {0, 1, Search::MAX_PLY - 1, -1};
+    int failures = 0, checks = 0;
+    uint64_t key = 0x9E3779B97F4A7C15ULL;
+    for (int score : scores) {
+        for (int depth : depths) {
+            key = key * 6364136223846793005ULL + 1442695040888963407ULL;
+            int move = 0xFFFFFF & (int)(key >> 20);
+            store(key, move, score, depth, Bound::Exact);
+            Entry entry;
+            checks++;
+            if (!probe(key, entry) || entry.move != move || entry.score != score ||
+                entry.depth != depth || entry.bound != Bound::Exact) {
+                std::cout << "TT test failed: score " << score << " depth " << depth << "\n";
+                failures++;
+            }
+        }
+    }
+    clear();
+    std::cout << "TT test: " << failures << " failures in " << checks << " entries\n";
+}
+
+} // namespace TT
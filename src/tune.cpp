@@ -0,0 +1,382 @@
+#include "tune.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "board.hpp"
+#include "eval_constants.hpp"
+#include "fen.hpp"
+#include "move.hpp"
+#include "parallel.hpp"
+#include "pgn.hpp"
+#include "search.hpp"
+
+namespace Tune {
+
+constexpr int FEATURES = 6 * 64;
+// Opening moves are mostly book moves, so they're not used for tuning
+constexpr int SKIPPED_PLIES = 8;
+
+void Dataset::append(const Dataset& other) {
+    uint32_t base = features.size();
+    features.insert(features.end(), other.features.begin(), other.features.end());
+    for (size_t i = 1; i < other.offsets.size(); i++)
+        offsets.push_back(base + other.offsets[i]);
+    phases.insert(phases.end(), other.phases.begin(), other.phases.end());
+    results.insert(results.end(), other.results.begin(), other.results.end());
+}
+
+bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open '" << path << "'\n";
+        return false;
+    }
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+void addPosition(Dataset& dataset, const Piece* board, const float result) {
+    int phase = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        if (board[sq] == Piece::E)
+            continue;
+        int type = COLORLESS(board[sq]);
+        bool black = (int)board[sq] >= 6;
+        int index = type * 64 + (black ? FLIP(sq) : sq);
+        dataset.features.push_back(index * 2 + black);
+        phase += phaseWeight[type];
+    }
+    dataset.offsets.push_back(dataset.features.size());
+    dataset.phases.push_back(std::min(phase, MAX_PHASE));
+    dataset.results.push_back(result);
+}
+
+void addPosition(Dataset& dataset, const Board& board, const float result) {
+    Piece pieces[64];
+    for (int sq = 0; sq < 64; sq++)
+        pieces[sq] = (Piece)board.pos.getPieceOnSquare(sq);
+    addPosition(dataset, pieces, result);
+}
+
+/* Result labels used by common quiet position sets: "1-0", "0-1", "1/2-1/2" or [1.0], [0.5],
+   [0.0]. Returns a negative value if there's none */
+float parseResult(const std::string& line) {
+    if (line.find("1/2-1/2") != std::string::npos || line.find("[0.5]") != std::string::npos)
+        return 0.5f;
+    if (line.find("1-0") != std::string::npos || line.find("[1.0]") != std::string::npos ||
+        line.find("[1]") != std::string::npos)
+        return 1.0f;
+    if (line.find("0-1") != std::string::npos || line.find("[0.0]") != std::string::npos ||
+        line.find("[0]") != std::string::npos)
+        return 0.0f;
+    return -1.0f;
+}
+
+/* Loads one quiet position per line, parsed in parallel over chunks of the file */
+bool loadEPD(const std::string& path, Dataset& dataset) {
+    std::string contents;
+    if (!readFile(path, contents))
+        return false;
+
+    int threads = Parallel::threadCount();
+    std::vector<Dataset> parts(threads);
+    Parallel::parallelFor(contents.size(), threads, [&](size_t begin, size_t end, int t) {
+        // Every chunk starts at the line following its first byte, the previous chunk owns
+        // the line that byte is in
+        if (begin > 0) {
+            while (begin < contents.size() && contents[begin - 1] != '\n')
+                begin++;
+        }
+        while (begin < end) {
+            size_t lineEnd = contents.find('\n', begin);
+            if (lineEnd == std::string::npos)
+                lineEnd = contents.size();
+            std::string line = contents.substr(begin, lineEnd - begin);
+            begin = lineEnd + 1;
+
+            float result = parseResult(line);
+            // Only the board, side, castling and en passant fields are needed
+            size_t fieldEnd = 0;
+            for (int field = 0; field < 4 && fieldEnd != std::string::npos; field++)
+                fieldEnd = line.find(' ', fieldEnd + (field > 0));
+            if (result < 0 || fieldEnd == std::string::npos)
+                continue;
+            FENInfo fen(line.substr(0, fieldEnd) + " 0 1");
+            addPosition(parts[t], fen.board, result);
+        }
+    });
+    for (const Dataset& part : parts)
+        dataset.append(part);
+    return true;
+}
+
+/* Loads the quiet positions of every game: positions after the opening where the side to
+   move isn't in check and the move played isn't a capture or promotion */
+bool loadPGN(const std::string& path, Dataset& dataset) {
+    PGN::ImportSettings settings;
+    settings.order = PGN::Order::Any;
+    std::vector<Dataset> parts(Parallel::threadCount(settings.threads));
+    auto addGame = [&](const PGNInfo& game, const int thread) {
+        GameResult gameResult = game.header.result;
+        if (gameResult == GameResult::InProgress)
+            return;
+        float result = gameResult == GameResult::WhiteWin ? 1.0f
+                       : gameResult == GameResult::Draw   ? 0.5f
+                                                          : 0.0f;
+        Board board(game.header.fen.empty() ? Board::position[1] : game.header.fen);
+        for (size_t ply = 0; ply < game.moves.size(); ply++) {
+            int move = game.moves[ply];
+            if (ply >= SKIPPED_PLIES && !board.isOppInCheck() && !Move::isCapture(move) &&
+                Move::getPromoted(move) == (int)Piece::E)
+                addPosition(parts[thread], board, result);
+            Move::make(&board, move, Move::MoveType::allMoves);
+        }
+    };
+    if (PGN::import(path, addGame, settings) < 0) {
+        std::cerr << "Failed to open '" << path << "'\n";
+        return false;
+    }
+    for (const Dataset& part : parts)
+        dataset.append(part);
+    return true;
+}
+
+/* The tuned weights: the midgame and endgame value of each piece type on each square, from
+   white's side, with the material included */
+struct Weights
+{
+    std::array<std::array<double, FEATURES>, 2> values{}; // [mg/eg][feature]
+};
+
+Weights currentWeights() {
+    Weights weights;
+    for (int type = 0; type < 6; type++) {
+        for (int sq = 0; sq < 64; sq++) {
+            weights.values[0][type * 64 + sq] = mgPieceValue[type] + mgPieceTable[type][sq];
+            weights.values[1][type * 64 + sq] = egPieceValue[type] + egPieceTable[type][sq];
+        }
+    }
+    return weights;
+}
+
+/* Same formula as Eval::evaluate, from white's point of view */
+inline double evaluate(const Dataset& dataset, const size_t i, const Weights& weights) {
+    double mg = 0.0, eg = 0.0;
+    for (uint32_t f = dataset.offsets[i]; f < dataset.offsets[i + 1]; f++) {
+        int feature = dataset.features[f];
+        double sign = (feature & 1) ? -1.0 : 1.0;
+        mg += sign * weights.values[0][feature >> 1];
+        eg += sign * weights.values[1][feature >> 1];
+    }
+    int phase = dataset.phases[i];
+    return (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+}
+
+inline double sigmoid(const double score, const double k) {
+    return 1.0 / (1.0 + std::pow(10.0, -k * score / 400.0));
+}
+
+double meanSquaredError(const Dataset& dataset, const Weights& weights, const double k) {
+    int threads = Parallel::threadCount();
+    std::vector<double> sums(threads, 0.0);
+    Parallel::parallelFor(dataset.size(), threads, [&](size_t begin, size_t end, int t) {
+        double sum = 0.0;
+        for (size_t i = begin; i < end; i++) {
+            double error = dataset.results[i] - sigmoid(evaluate(dataset, i, weights), k);
+            sum += error * error;
+        }
+        sums[t] = sum;
+    });
+    double total = 0.0;
+    for (double sum : sums)
+        total += sum;
+    return total / std::max<size_t>(1, dataset.size());
+}
+
+/* The sigmoid scaling that best fits the current weights, so tuning only has to move the
+   weights and not their overall scale */
+double fitScaling(const Dataset& dataset, const Weights& weights) {
+    double best = 1.0, bestError = meanSquaredError(dataset, weights, best);
+    for (double step = 0.5; step >= 0.001; step /= 10.0) {
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            for (double k : {best - step, best + step}) {
+                if (k <= 0.0)
+                    continue;
+                double error = meanSquaredError(dataset, weights, k);
+                if (error < bestError) {
+                    best = k;
+                    bestError = error;
+                    improved = true;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+/* Gradient of the mean squared error over the whole dataset, returns the error */
+double gradient(const Dataset& dataset, const Weights& weights, const double k, Weights& grad) {
+    int threads = Parallel::threadCount();
+    std::vector<Weights> partial(threads);
+    std::vector<double> sums(threads, 0.0);
+    const double slope = k * std::log(10.0) / 400.0;
+    Parallel::parallelFor(dataset.size(), threads, [&](size_t begin, size_t end, int t) {
+        Weights& g = partial[t];
+        double sum = 0.0;
+        for (size_t i = begin; i < end; i++) {
+            double s = sigmoid(evaluate(dataset, i, weights), k);
+            double error = dataset.results[i] - s;
+            sum += error * error;
+            double dScore = -2.0 * error * s * (1.0 - s) * slope;
+            double mgFactor = dScore * dataset.phases[i] / MAX_PHASE;
+            double egFactor = dScore - mgFactor;
+            for (uint32_t f = dataset.offsets[i]; f < dataset.offsets[i + 1]; f++) {
+                int feature = dataset.features[f];
+                double sign = (feature & 1) ? -1.0 : 1.0;
+                g.values[0][feature >> 1] += sign * mgFactor;
+                g.values[1][feature >> 1] += sign * egFactor;
+            }
+        }
+        sums[t] = sum;
+    });
+
+    double n = std::max<size_t>(1, dataset.size());
+    double error = 0.0;
+    grad = Weights();
+    for (int t = 0; t < threads; t++) {
+        error += sums[t];
+        for (int phase = 0; phase < 2; phase++) {
+            for (int f = 0; f < FEATURES; f++)
+                grad.values[phase][f] += partial[t].values[phase][f] / n;
+        }
+    }
+    return error / n;
+}
+
+/* Writes the weights in the layout of eval_constants.hpp. The piece values are the average
+   over the squares a piece can stand on, and the tables keep the rest */
+bool writeHeader(const std::string& path, const Weights& weights) {
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "Failed to write '" << path << "'\n";
+        return false;
+    }
+    const char* names[6] = {"Pawn", "Knight", "Bishop", "Rook", "Queen", "King"};
+    std::array<std::array<int, 6>, 2> values{};
+    std::array<std::array<std::array<int, 64>, 6>, 2> tables{};
+    for (int phase = 0; phase < 2; phase++) {
+        for (int type = 0; type < 6; type++) {
+            // Pawns never stand on the first or last rank
+            int first = type == (int)PieceTypes::PAWN ? 8 : 0;
+            int last = type == (int)PieceTypes::PAWN ? 56 : 64;
+            double sum = 0.0;
+            for (int sq = first; sq < last; sq++)
+                sum += weights.values[phase][type * 64 + sq];
+            values[phase][type] =
+                type == (int)PieceTypes::KING ? 0 : (int)std::lround(sum / (last - first));
+            for (int sq = first; sq < last; sq++)
+                tables[phase][type][sq] =
+                    (int)std::lround(weights.values[phase][type * 64 + sq]) - values[phase][type];
+        }
+    }
+
+    std::fprintf(file, "#pragma once\n\n#include \"defs.hpp\"\n\n");
+    std::fprintf(file,
+                 "/* Evaluation weights in centipawns. The piece-square tables are from white's "
+                 "point of view and\n   laid out like the board is printed: a8 is the first "
+                 "entry, h1 the last. This file may be\n   regenerated by the tuner */\n\n");
+    std::fprintf(file, "// [piece type]\n");
+    for (int phase = 0; phase < 2; phase++) {
+        std::fprintf(file, "const std::array<int, 6> %sPieceValue = {", phase ? "eg" : "mg");
+        for (int type = 0; type < 6; type++)
+            std::fprintf(file, "%s%d", type ? ", " : "", values[phase][type]);
+        std::fprintf(file, "};\n");
+    }
+    std::fprintf(file, "\n// clang-format off\n// [piece type][square]\n");
+    for (int phase = 0; phase < 2; phase++) {
+        std::fprintf(file, "const std::array<std::array<int, 64>, 6> %sPieceTable = {{\n",
+                     phase ? "eg" : "mg");
+        for (int type = 0; type < 6; type++) {
+            std::fprintf(file, "    { // %s\n", names[type]);
+            for (int rank = 0; rank < 8; rank++) {
+                std::fprintf(file, "       ");
+                for (int file_ = 0; file_ < 8; file_++)
+                    std::fprintf(file, "%5d,", tables[phase][type][rank * 8 + file_]);
+                std::fprintf(file, "\n");
+            }
+            std::fprintf(file, "    },\n");
+        }
+        std::fprintf(file, "}};\n%s", phase ? "" : "\n");
+    }
+    std::fprintf(file, "// clang-format on\n\n");
+    std::fprintf(file, "// Game phase contributed by each piece type. The sum is 24 at the start "
+                       "and falls towards 0 as\n// pieces are traded, blending the midgame score "
+                       "into the endgame one\n");
+    std::fprintf(file, "const std::array<int, 6> phaseWeight = {");
+    for (int type = 0; type < 6; type++)
+        std::fprintf(file, "%s%d", type ? ", " : "", phaseWeight[type]);
+    std::fprintf(file, "};\nconstexpr int MAX_PHASE = %d;\n", MAX_PHASE);
+    std::fclose(file);
+    return true;
+}
+
+/* Texel tuning: minimizes the squared error between the game results and the sigmoid of the
+   evaluation with full batch Adam, starting from the current weights */
+void run(const Settings& settings) {
+    constexpr double BETA1 = 0.9, BETA2 = 0.999, EPSILON = 1e-8;
+    constexpr int REPORT_INTERVAL = 50;
+
+    Dataset dataset;
+    long long start = Search::now();
+    for (const std::string& path : settings.files) {
+        bool pgn = path.size() >= 4 && path.substr(path.size() - 4) == ".pgn";
+        if (!(pgn ? loadPGN(path, dataset) : loadEPD(path, dataset)))
+            return;
+    }
+    std::cout << "Loaded " << dataset.size() << " positions in " << Search::now() - start
+              << " ms\n";
+    if (dataset.size() == 0)
+        return;
+
+    Weights weights = currentWeights();
+    double k = fitScaling(dataset, weights);
+    std::cout << "Scaling K = " << k << ", initial error "
+              << meanSquaredError(dataset, weights, k) << "\n";
+
+    Weights m, v, grad;
+    start = Search::now();
+    for (int epoch = 1; epoch <= settings.epochs; epoch++) {
+        double error = gradient(dataset, weights, k, grad);
+        for (int phase = 0; phase < 2; phase++) {
+            for (int f = 0; f < FEATURES; f++) {
+                double g = grad.values[phase][f];
+                m.values[phase][f] = BETA1 * m.values[phase][f] + (1.0 - BETA1) * g;
+                v.values[phase][f] = BETA2 * v.values[phase][f] + (1.0 - BETA2) * g * g;
+                double mHat = m.values[phase][f] / (1.0 - std::pow(BETA1, epoch));
+                double vHat = v.values[phase][f] / (1.0 - std::pow(BETA2, epoch));
+                weights.values[phase][f] -=
+                    settings.learningRate * mHat / (std::sqrt(vHat) + EPSILON);
+            }
+        }
+        if (epoch % REPORT_INTERVAL == 0 || epoch == settings.epochs) {
+            long long elapsed = Search::now() - start;
+            std::printf("Epoch %5d  error %.6f  %.1f ms/epoch\n", epoch, error,
+                        (double)elapsed / epoch);
+            std::fflush(stdout);
+        }
+    }
+
+    if (writeHeader(settings.output, weights))
+        std::cout << "Wrote " << settings.output << "\n";
+}
+
+} // namespace Tune
@@ -1,69 +1,291 @@
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iostream>
-#include <regex>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 const std::string filename = "tests/test_uci.txt";
-const std::string pattern = "(\\w+)";
 
 #include "board.hpp"
-void parsePositionCmd(const std::string& positionCmd) {
-    std::string posCmd = positionCmd;
-    size_t spaceInd = posCmd.find(' ');
-    std::string posType = posCmd.substr(0, spaceInd);
-}
+#include "move.hpp"
+#include "options.hpp"
+#include "search.hpp"
+#include "tt.hpp"
+#include "uci.hpp"
 
-void parseCommand(const std::string& cmdStr) {
-    std::regex regex(pattern);
-    std::smatch match;
-    std::string cmd = cmdStr;
-
-    while (std::regex_search(cmd, match, regex)) {
-        if (match[1] == "position")
-            parsePositionCmd(cmd.substr(cmd.find(match[1]) + match[1].str().size() + 1));
-        /* else if (match[1] == "ucinewgame")
-            parsePositionCmd("startpos"); */
-        cmd = match.suffix();
+/* Parses the arguments of a 'go' command into search limits */
+Search::Limits parseGoCmd(const std::string& goCmd, const Board& board) {
+    Search::Limits limits;
+    std::istringstream ss(goCmd);
+    std::string token;
+    bool readingMoves = false;
+    while (ss >> token) {
+        // 'searchmoves' takes every move up to the next keyword, no keyword looks like "e2e4"
+        bool looksLikeMove = token.length() >= 4 && token[0] >= 'a' && token[0] <= 'h' &&
+                             std::isdigit((unsigned char)token[1]);
+        if (readingMoves && looksLikeMove) {
+            int move = Move::parse(token, board);
+            Board next = board;
+            bool known = std::find(limits.searchMoves.begin(), limits.searchMoves.end(), move) !=
+                         limits.searchMoves.end();
+            if (move && !known && Move::make(&next, move, Move::MoveType::allMoves))
+                limits.searchMoves.push_back(move);
+            continue;
+        }
+        readingMoves = false;
+        if (token == "searchmoves")
+            readingMoves = true;
+        else if (token == "mate")
+            ss >> limits.mate;
+        else if (token == "wtime")
+            ss >> limits.wtime;
+        else if (token == "btime")
+            ss >> limits.btime;
+        else if (token == "winc")
+            ss >> limits.winc;
+        else if (token == "binc")
+            ss >> limits.binc;
+        else if (token == "movestogo")
+            ss >> limits.movestogo;
+        else if (token == "movetime")
+            ss >> limits.movetime;
+        else if (token == "depth")
+            ss >> limits.depth;
+        else if (token == "nodes")
+            ss >> limits.nodes;
+        else if (token == "infinite")
+            limits.infinite = true;
+        else if (token == "ponder")
+            limits.ponder = true;
     }
+    return limits;
 }
 
-std::string readCmdOutput(const std::string& cmd) {
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) {
-        std::cerr << "Failed to run command: '" << cmd << "'\n";
-        return "";
+/* The game the GUI has set up. GUIs resend the whole move list before every 'go', so a command
+   that extends the previous one only plays the new moves, keeping the cost per command constant
+   however long the game gets */
+struct Game
+{
+    Board board{Board::position[1]};
+    // Keys of the positions before the current one, oldest first
+    std::vector<uint64_t> history;
+    // Arguments of the last 'position' command that was applied
+    std::string positionCmd;
+
+    // Plays the moves in the stream, skipping a leading 'moves' token, and records the keys of
+    // the positions left behind
+    static bool playMoves(std::istringstream& ss, Board& board, std::vector<uint64_t>& keys) {
+        std::string token;
+        while (ss >> token) {
+            if (token == "moves")
+                continue;
+            int move = token.length() >= 4 ? Move::parse(token, board) : 0;
+            Board next = board;
+            if (!move || !Move::make(&next, move, Move::MoveType::allMoves))
+                return false;
+            keys.push_back(board.state.key);
+            board = next;
+        }
+        return true;
     }
 
-    std::stringstream ss;
-    char buf[256];
-    while (!feof(pipe)) {
-        if (fgets(buf, 256, pipe) != NULL) {
-            ss << buf;
+    /* Sets up the board from 'startpos' or 'fen <fen>', followed by an optional list of moves.
+       Returns false and leaves the game alone if any part is invalid */
+    bool setPosition(const std::string& cmd) {
+        std::vector<uint64_t> keys;
+        // Same start and the old moves as a prefix: only the new moves are played
+        if (!positionCmd.empty() && cmd.compare(0, positionCmd.size(), positionCmd) == 0 &&
+            (cmd.size() == positionCmd.size() || cmd[positionCmd.size()] == ' ')) {
+            Board next = board;
+            std::istringstream ss(cmd.substr(positionCmd.size()));
+            if (!playMoves(ss, next, keys))
+                return false;
+            board = next;
+            history.insert(history.end(), keys.begin(), keys.end());
+            positionCmd = cmd;
+            return true;
+        }
+
+        std::istringstream ss(cmd);
+        std::string token, fen;
+        ss >> token;
+        if (token == "startpos") {
+            fen = Board::position[1];
+        } else if (token == "fen") {
+            while (ss >> token && token != "moves")
+                fen += (fen.empty() ? "" : " ") + token;
+        } else {
+            return false;
         }
+        Board next(fen);
+        if (!playMoves(ss, next, keys))
+            return false;
+        board = next;
+        history = std::move(keys);
+        positionCmd = cmd;
+        return true;
     }
 
-    pclose(pipe);
-    return ss.str();
+    // Only positions since the last capture or pawn move can repeat
+    std::vector<uint64_t> repetitionHistory() const {
+        size_t count = std::min<size_t>(history.size(), board.state.halfMoves);
+        return std::vector<uint64_t>(history.end() - count, history.end());
+    }
+};
+
+/* 'setoption name <name> value <value>', both name and value may contain spaces */
+void parseSetOptionCmd(const std::string& setOptionCmd) {
+    std::istringstream ss(setOptionCmd);
+    std::string token, name, value;
+    ss >> token;
+    if (token != "name")
+        return;
+    while (ss >> token && token != "value")
+        name += (name.empty() ? "" : " ") + token;
+    if (token == "value")
+        std::getline(ss >> std::ws, value);
+    if (!Options::set(name, value))
+        std::cout << "info string No such option: " << name << std::endl;
 }
 
+/* Lines read from stdin, in order. A dedicated thread fills it so the main loop never blocks on
+   input, and a 'stop' reaches the search as soon as it's read */
+struct CommandQueue
+{
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<std::string> lines;
 
-void uciTest() {
-    std::string output = readCmdOutput("../Stockfish/src/stockfish");
-    std::cout << "position startpos\r";
-    std::cout << output << "\n";
+    void push(const std::string& line) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            lines.push_back(line);
+        }
+        available.notify_one();
+    }
+
+    std::string pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this] { return !lines.empty(); });
+        std::string line = std::move(lines.front());
+        lines.pop_front();
+        return line;
+    }
+};
+
+struct UCISession
+{
+    Game game;
+    std::thread searchThread;
+
+    // Commands that change the engine's state end any search still running first
+    void stopSearch() {
+        if (!searchThread.joinable())
+            return;
+        Search::stop();
+        searchThread.join();
+    }
+
+    /* Runs one command, returns false once the engine should quit */
+    bool execute(const std::string& line) {
+        std::istringstream ss(line);
+        std::string command, args;
+        ss >> command;
+        std::getline(ss >> std::ws, args);
+
+        if (command == "uci") {
+            std::cout << "id name CEGUI\n";
+            std::cout << "id author michabay05\n";
+            Options::print();
+            std::cout << "uciok" << std::endl;
+        } else if (command == "isready") {
+            std::cout << "readyok" << std::endl;
+        } else if (command == "setoption") {
+            stopSearch();
+            parseSetOptionCmd(args);
+        } else if (command == "ucinewgame") {
+            stopSearch();
+            TT::clear();
+            game = Game();
+        } else if (command == "position") {
+            stopSearch();
+            if (!game.setPosition(args))
+                std::cout << "info string Invalid position: " << args << std::endl;
+        } else if (command == "go") {
+            stopSearch();
+            searchThread = Search::start(game.board, parseGoCmd(args, game.board),
+                                         game.repetitionHistory());
+        } else if (command == "stop") {
+            Search::stop();
+        } else if (command == "ponderhit") {
+            Search::ponderhit();
+        } else if (command == "stats") {
+            // The search thread adds to the statistics while it runs
+            if (Search::isRunning()) {
+                std::cout << "info string Stats are available once the search has finished"
+                          << std::endl;
+            } else {
+                if (searchThread.joinable())
+                    searchThread.join();
+                Search::printStats();
+            }
+        } else if (command == "d") {
+            game.board.display();
+        } else if (command == "quit") {
+            stopSearch();
+            return false;
+        } else if (!command.empty()) {
+            std::cout << "info string Unknown command: " << command << std::endl;
+        }
+        return true;
+    }
+};
+
+void uciLoop() {
+    // Outlives the loop, as the detached reader may still be blocked reading when it ends
+    static CommandQueue queue;
+    std::thread reader([] {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            // Windows GUIs may end lines with CRLF
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            queue.push(line);
+            if (line == "quit")
+                return;
+        }
+        queue.push("quit");
+    });
+    reader.detach();
+
+    UCISession session;
+    while (session.execute(queue.pop()))
+        ;
 }
 
-void a() {
+/* Runs the GUI to engine section of the test file through the command handler */
+void uciTest() {
     std::ifstream file(filename);
     std::string buf;
-
+    UCISession session;
     while (std::getline(file, buf)) {
+        if (buf.empty())
+            continue;
         if (buf[0] == '#') {
-            std::cout << "=================" << buf.substr(1) << " SECTION "
-                      << "=================\n";
+            // Only the commands a GUI sends are executed
+            if (buf.find("GUI TO ENGINE") == std::string::npos)
+                break;
             continue;
         }
-        parseCommand(buf);
+        std::cout << "> " << buf << "\n";
+        if (!session.execute(buf))
+            break;
     }
+    session.stopSearch();
 }
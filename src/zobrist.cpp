@@ -0,0 +1,53 @@
+#include "zobrist.hpp"
+
+#include "bitboard.hpp"
+
+namespace Zobrist {
+
+std::array<std::array<uint64_t, 64>, 12> pieceKeys; // [piece][square]
+std::array<uint64_t, 64> enpassantKeys;             // [square]
+std::array<uint64_t, 16> castlingKeys;              // [castling rights]
+uint64_t sideKey;
+
+uint64_t randomState = 0x9E3779B97F4A7C15ULL;
+
+uint64_t random64() {
+    // XOR shift algorithm
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return randomState * 0x2545F4914F6CDD1DULL;
+}
+
+/* Initializes the random keys used to hash positions */
+void init() {
+    for (auto& squares : pieceKeys)
+        for (uint64_t& key : squares)
+            key = random64();
+    for (uint64_t& key : enpassantKeys)
+        key = random64();
+    for (uint64_t& key : castlingKeys)
+        key = random64();
+    sideKey = random64();
+}
+
+/* Hashes a position from scratch. Move::make keeps the key up to date incrementally */
+uint64_t generate(const Board& board) {
+    uint64_t key = 0ULL;
+    for (int piece = (int)Piece::P; piece <= (int)Piece::k; piece++) {
+        uint64_t bitboard = board.pos.pieces[piece];
+        while (bitboard) {
+            int sq = Bitboard::lsbIndex(bitboard);
+            key ^= pieceKeys[piece][sq];
+            popBit(bitboard, sq);
+        }
+    }
+    if (board.state.enpassant != Sq::noSq)
+        key ^= enpassantKeys[(int)board.state.enpassant];
+    key ^= castlingKeys[board.state.castling];
+    if (board.state.side == PieceColor::DARK)
+        key ^= sideKey;
+    return key;
+}
+
+} // namespace Zobrist